@@ -8,318 +8,3593 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <memory_resource>
 #include <variant>
-#include <unordered_map>
 #include <functional>
+#include <utility>
+#include <optional>
 #include <mutex>
+#include <condition_variable>
+#include <future>
 #include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <cassert>
 
 #if !(__cplusplus > 202002L)
 #undef SAFE_CALLBACKS_DEBUG_PRINTS
 #define SAFE_CALLBACKS_DEBUG_PRINTS 0
 #elif !defined(SAFE_CALLBACKS_DEBUG_PRINTS)
 #define SAFE_CALLBACKS_DEBUG_PRINTS 0
-#elif DEBUG
-#define SAFE_CALLBACKS_GET_NAME(impl) impl->name.length() > 0 ? impl->name : "<unnamed>"
-#else
-#define SAFE_CALLBACKS_GET_NAME(impl) "<unnamed>"
 #endif
 
 #if SAFE_CALLBACKS_DEBUG_PRINTS
 #include <print>
 #endif
-
-namespace {
-template <typename DVR>
-using default_value_t = std::conditional_t<!std::is_void_v<DVR>, DVR, std::monostate>;
-
-template <typename R>
-struct is_constructible_rv : std::conditional_t<std::is_void_v<R> || std::is_constructible_v<R>, std::true_type, std::false_type> {};
-template <typename R>
-static inline constexpr bool is_constructible_rv_v = is_constructible_rv<R>::value;
-
-template <typename DVR, typename R>
-struct is_compatible_rv : std::conditional_t<std::is_same_v<DVR, R> || std::is_convertible_v<DVR, R>, std::true_type, std::false_type> {};
-template <typename DVR, typename R>
-static inline constexpr bool is_compatible_rv_v = is_compatible_rv<DVR, R>::value;
-
-template <typename DVR>
-struct is_returnable_rv : std::conditional_t<std::is_copy_constructible_v<DVR> || std::is_move_constructible_v<DVR>, std::true_type, std::false_type> {};
-template <typename DVR>
-static inline constexpr bool is_returnable_rv_v = is_returnable_rv<DVR>::value;
-
-// Helper class. Instances of this class may be released after the main safe_callbacks instance is released,
-// but it will be marked as is_cancelled=true and all registered callables will be cancelled.
-class safe_callbacks_impl
-{
-public:
-	safe_callbacks_impl() = default;
-	safe_callbacks_impl(const safe_callbacks_impl&) = delete;
-	safe_callbacks_impl& operator=(const safe_callbacks_impl&) = delete;
+
+// Whether wrappers keep the name passed to make_safe(). Defaults to DEBUG builds.
+#if !defined(SAFE_CALLBACKS_NAMES)
+#if DEBUG
+#define SAFE_CALLBACKS_NAMES 1
+#else
+#define SAFE_CALLBACKS_NAMES 0
+#endif
+#endif
+
+// Whether single-threaded owners assert that they and their wrappers are only used on the thread that created them.
+// Defaults to DEBUG builds.
+#if !defined(SAFE_CALLBACKS_THREAD_CHECKS)
+#if DEBUG
+#define SAFE_CALLBACKS_THREAD_CHECKS 1
+#else
+#define SAFE_CALLBACKS_THREAD_CHECKS 0
+#endif
+#endif
+
+// Whether owners with a statistics object count their wrappers' activity. Off by default.
+#if !defined(SAFE_CALLBACKS_STATISTICS)
+#define SAFE_CALLBACKS_STATISTICS 0
+#endif
+
+// Whether tracing events are reported. Defaults to SAFE_CALLBACKS_DEBUG_PRINTS, which installs a hook printing them.
+#if !defined(SAFE_CALLBACKS_TRACING)
+#define SAFE_CALLBACKS_TRACING SAFE_CALLBACKS_DEBUG_PRINTS
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define SAFE_CALLBACKS_COROUTINES 1
+#else
+#define SAFE_CALLBACKS_COROUTINES 0
+#endif
+
+// Whether the state of each wrapper is aligned to its own cache lines, so that calls of wrappers allocated next to each
+// other (in a batch, or by a pooling memory resource) do not contend on shared lines. Off by default, as it costs memory.
+#if !defined(SAFE_CALLBACKS_PADDED_WRAPPERS)
+#define SAFE_CALLBACKS_PADDED_WRAPPERS 0
+#endif
+
+// Number of independently locked stripes of an owner's registry of wrappers.
+#if !defined(SAFE_CALLBACKS_REGISTRY_STRIPES)
+#define SAFE_CALLBACKS_REGISTRY_STRIPES 8
+#endif
+
+// State which must exist once per program. It is kept out of the anonymous namespace below, which gives each translation
+// unit its own copy of everything declared in it.
+namespace safe_callbacks_detail {
+// A call running on this thread, and the gate it entered.
+struct call_frame
+{
+	const void* gate;
+	call_frame* previous;
+};
+
+// The innermost call running on this thread, whatever translation unit it was made from.
+inline thread_local call_frame* current_call_frame = nullptr;
+
+// Events reported to the tracing hook, if tracing is enabled.
+enum class trace_event : uint8_t
+{
+	cancellable_added,
+	cancellable_removed,
+	wrapper_cancelled,
+	wrapper_destroyed,
+	call_executing,
+	call_ignored,
+	posted_task_ignored,
+	coroutine_destroyed,
+	owner_destroyed
+};
+
+// Receives tracing events, with the name of the wrapper concerned if there is one and names are enabled, null otherwise.
+// Called inline on the thread the event happens on, possibly with registry locks held, and must not throw.
+using trace_hook = void (*)(trace_event event, const char* name);
+
+// The hook installed with safe_callbacks::set_trace_hook(), for every translation unit. Null until one is installed.
+inline std::atomic<trace_hook> installed_trace_hook = nullptr;
+
+// Installed in place of a null hook, which would otherwise stand for no hook installed.
+inline void ignore_trace(trace_event, const char*) noexcept {}
+
+// A cancelled callable handed over to a reclaimer. Reclaiming the task destroys the callable and frees the task.
+class reclamation_task
+{
+public:
+	reclamation_task() = default;
+	reclamation_task(const reclamation_task&) = delete;
+	reclamation_task& operator=(const reclamation_task&) = delete;
+	
+	/// Destroys the callable, and frees the task through the allocator of the owner it came from.
+	virtual void reclaim() noexcept = 0;
+	
+	// Intrusive link, for use by reclaimers.
+	reclamation_task* next = nullptr;
+	
+protected:
+	// Tasks are not deleted, but reclaimed.
+	~reclamation_task() = default;
+};
+
+// Receives cancelled callables, so that their destructors run away from the cancelling thread.
+class reclaimer
+{
+public:
+	virtual ~reclaimer() = default;
+	
+	/// Takes ownership of `task`, which must eventually be reclaimed.
+	virtual void post(reclamation_task* task) = 0;
+	/// Blocks until every task posted so far has been reclaimed.
+	virtual void flush() = 0;
+};
+
+// Reclaimer reclaiming posted tasks, in order, on a background thread of its own.
+class background_reclaimer: public reclaimer
+{
+public:
+	background_reclaimer(): thread([this] { run(); }) {}
+	background_reclaimer(const background_reclaimer&) = delete;
+	background_reclaimer& operator=(const background_reclaimer&) = delete;
+	~background_reclaimer()
+	{
+		{
+			std::lock_guard lock(this->lock);
+			stopping = true;
+		}
+		pending.notify_one();
+		thread.join();
+	}
+	
+	/// A process-wide instance, shared by every translation unit and started on first use.
+	static background_reclaimer& shared()
+	{
+		static background_reclaimer instance;
+		return instance;
+	}
+	
+	void post(reclamation_task* task) override
+	{
+		{
+			std::lock_guard lock(this->lock);
+			task->next = nullptr;
+			(tail != nullptr ? tail->next : head) = task;
+			tail = task;
+		}
+		pending.notify_one();
+	}
+	
+	/// Must not be called from a callable's destructor, as those run on the reclaimer's own thread.
+	void flush() override
+	{
+		std::unique_lock lock(this->lock);
+		idle.wait(lock, [&] { return head == nullptr && !reclaiming; });
+	}
+	
+private:
+	void run()
+	{
+		std::unique_lock lock(this->lock);
+		while(true)
+		{
+			pending.wait(lock, [&] { return head != nullptr || stopping; });
+			if(head == nullptr)
+			{
+				return;
+			}
+			
+			auto task = head;
+			head = tail = nullptr;
+			reclaiming = true;
+			
+			lock.unlock();
+			while(task != nullptr)
+			{
+				std::exchange(task, task->next)->reclaim();
+			}
+			lock.lock();
+			
+			reclaiming = false;
+			idle.notify_all();
+		}
+	}
+	
+	std::mutex lock;
+	std::condition_variable pending;
+	std::condition_variable idle;
+	reclamation_task* head = nullptr;
+	reclamation_task* tail = nullptr;
+	bool reclaiming = false;
+	bool stopping = false;
+	std::thread thread;
+};
+}
+
+namespace {
+template <typename DVR>
+using default_value_t = std::conditional_t<!std::is_void_v<DVR>, DVR, std::monostate>;
+
+// Helper class. Holds a factory. Stateless factories are a base instead of a member, so that holding them takes no room.
+template <typename F, bool Stateless = std::is_empty_v<F> && !std::is_final_v<F>>
+class safe_factory_holder
+{
+public:
+	constexpr safe_factory_holder(F factory): factory(std::move(factory)) {}
+	
+	inline constexpr
+	const F& get() const noexcept
+	{
+		return factory;
+	}
+	
+private:
+	F factory;
+};
+
+template <typename F>
+class safe_factory_holder<F, true>: private F
+{
+public:
+	constexpr safe_factory_holder(F factory): F(std::move(factory)) {}
+	
+	inline constexpr
+	const F& get() const noexcept
+	{
+		return *this;
+	}
+};
+
+// A default return value made by a factory for each cancelled call. Wrappers hold the factory instead of a value: nothing at all
+// for stateless factories, and move-only values can be returned by any number of cancelled calls.
+template <typename F>
+class safe_default_factory: private safe_factory_holder<F>
+{
+public:
+	constexpr explicit safe_default_factory(F factory = F()): safe_factory_holder<F>(std::move(factory)) {}
+	
+	inline constexpr
+	auto operator()() const
+	{
+		return std::invoke(this->get());
+	}
+};
+
+// Helper class. The stateless factory of a default return value known at compile time.
+template <auto Value>
+struct safe_constant_factory
+{
+	inline constexpr
+	auto operator()() const noexcept
+	{
+		return Value;
+	}
+};
+
+template <typename DVR>
+struct is_default_factory : std::false_type {};
+template <typename F>
+struct is_default_factory<safe_default_factory<F>> : std::true_type {};
+template <typename DVR>
+static inline constexpr bool is_default_factory_v = is_default_factory<std::remove_cv_t<std::remove_reference_t<DVR>>>::value;
+
+// The type of the value a default return value stands for: the result of a default factory, or itself.
+template <typename DVR, bool = is_default_factory_v<DVR>>
+struct default_result
+{
+	using type = DVR;
+};
+template <typename DVR>
+struct default_result<DVR, true>
+{
+	using type = std::invoke_result_t<const std::remove_cv_t<std::remove_reference_t<DVR>>&>;
+};
+template <typename DVR>
+using default_result_t = typename default_result<DVR>::type;
+
+template <typename R>
+struct is_constructible_rv : std::conditional_t<std::is_void_v<R> || std::is_constructible_v<R>, std::true_type, std::false_type> {};
+template <typename R>
+static inline constexpr bool is_constructible_rv_v = is_constructible_rv<R>::value;
+
+template <typename DVR, typename R>
+struct is_compatible_rv : std::conditional_t<std::is_same_v<default_result_t<DVR>, R> || std::is_convertible_v<default_result_t<DVR>, R>, std::true_type, std::false_type> {};
+template <typename DVR, typename R>
+static inline constexpr bool is_compatible_rv_v = is_compatible_rv<DVR, R>::value;
+
+template <typename DVR>
+struct is_returnable_rv : std::conditional_t<is_default_factory_v<DVR> || std::is_copy_constructible_v<DVR> || std::is_move_constructible_v<DVR>, std::true_type, std::false_type> {};
+template <typename DVR>
+static inline constexpr bool is_returnable_rv_v = is_returnable_rv<DVR>::value;
+
+template <typename ...T>
+struct type_list {};
+
+// Whether call arguments of types `A...` can be passed as parameters of types `Args...`, as std::function::operator() would.
+template <typename A, typename Args, typename = void>
+struct is_forwardable_args : std::false_type {};
+template <typename ...A, typename ...Args>
+struct is_forwardable_args<type_list<A...>, type_list<Args...>, std::enable_if_t<sizeof...(A) == sizeof...(Args)>> : std::conjunction<std::is_convertible<A&&, Args>...> {};
+template <typename A, typename Args>
+static inline constexpr bool is_forwardable_args_v = is_forwardable_args<A, Args>::value;
+
+// Forwards a call argument to a `T&&` parameter. A copy is only made when `T` is an object type and the argument
+// is not already an rvalue of that type.
+template <typename T, typename A>
+inline decltype(auto) forward_argument(A&& argument)
+{
+	if constexpr(std::is_reference_v<T> || std::is_same_v<A, T>)
+	{
+		return std::forward<A>(argument);
+	}
+	else
+	{
+		return T(std::forward<A>(argument));
+	}
+}
+
+// Build configuration, from the SAFE_CALLBACKS_* macros.
+struct safe_callbacks_config
+{
+	static constexpr bool names = SAFE_CALLBACKS_NAMES;
+	static constexpr bool tracing = SAFE_CALLBACKS_TRACING;
+	static constexpr bool statistics = SAFE_CALLBACKS_STATISTICS;
+	static constexpr bool thread_checks = SAFE_CALLBACKS_THREAD_CHECKS;
+	static constexpr bool padded_wrappers = SAFE_CALLBACKS_PADDED_WRAPPERS;
+};
+
+using safe_trace_event = safe_callbacks_detail::trace_event;
+using safe_trace_hook = safe_callbacks_detail::trace_hook;
+
+// Helper class. Dispatches tracing events to the installed hook, or to this translation unit's default one until a hook
+// is installed. Compiles to nothing if tracing is disabled.
+class safe_tracer
+{
+public:
+	static inline
+	void trace([[maybe_unused]] safe_trace_event event, [[maybe_unused]] const char* name = nullptr) noexcept
+	{
+		if constexpr(safe_callbacks_config::tracing)
+		{
+			auto hook = safe_callbacks_detail::installed_trace_hook.load(std::memory_order_acquire);
+			if(hook == nullptr)
+			{
+				hook = default_hook;
+			}
+			if(hook != nullptr)
+			{
+				hook(event, name);
+			}
+		}
+	}
+	
+	static inline
+	void set_hook(safe_trace_hook hook) noexcept
+	{
+		safe_callbacks_detail::installed_trace_hook.store(hook != nullptr ? hook : &safe_callbacks_detail::ignore_trace, std::memory_order_release);
+	}
+	
+private:
+#if SAFE_CALLBACKS_DEBUG_PRINTS
+	static void print(safe_trace_event event, const char* name)
+	{
+		name = name != nullptr && *name != '\0' ? name : "<unnamed>";
+		switch(event)
+		{
+			case safe_trace_event::cancellable_added:
+				std::println("Adding cancellable");
+				break;
+			case safe_trace_event::cancellable_removed:
+				std::println("Removing cancellable");
+				break;
+			case safe_trace_event::wrapper_cancelled:
+				std::println("Cancelling function wrapper of {0}", name);
+				break;
+			case safe_trace_event::wrapper_destroyed:
+				std::println("Destructing safe_function_wrapper_impl of {0}", name);
+				break;
+			case safe_trace_event::call_executing:
+				std::println("(): executing");
+				break;
+			case safe_trace_event::call_ignored:
+				std::println("(): ignoring");
+				break;
+			case safe_trace_event::posted_task_ignored:
+				std::println("(): ignoring posted task");
+				break;
+			case safe_trace_event::coroutine_destroyed:
+				std::println("(): destroying coroutine");
+				break;
+			case safe_trace_event::owner_destroyed:
+				std::println("Destructing safe_callbacks");
+				break;
+		}
+	}
+	
+	static constexpr safe_trace_hook default_hook = &print;
+#else
+	static constexpr safe_trace_hook default_hook = nullptr;
+#endif
+};
+
+// Helper class. The name a wrapper was given in make_safe(), kept only if names are enabled. Empty otherwise, so that
+// wrappers deriving from it carry no name at all.
+template <bool Enabled = safe_callbacks_config::names>
+class safe_wrapper_name
+{
+public:
+	safe_wrapper_name(const char* name): value(name) {}
+	
+	inline
+	const char* name() const noexcept
+	{
+		return value.c_str();
+	}
+	
+private:
+	std::string value;
+};
+
+template <>
+class safe_wrapper_name<false>
+{
+public:
+	safe_wrapper_name(const char*) noexcept {}
+	
+	inline
+	const char* name() const noexcept
+	{
+		return nullptr;
+	}
+};
+
+// Helper class. Tracks in-flight calls of a wrapper without making callers serialize against each other.
+// The top bits of `state` hold the closed/deferred/claimed/detached flags, the remaining bits count in-flight calls.
+class safe_call_gate
+{
+public:
+	safe_call_gate(void (*drained)(safe_call_gate*) = nullptr): drained(drained) {}
+	safe_call_gate(const safe_call_gate&) = delete;
+	safe_call_gate& operator=(const safe_call_gate&) = delete;
+	
+	/// Registers a call. Returns false, without registering, if the gate has been closed.
+	inline
+	bool try_enter() noexcept
+	{
+		if((state.fetch_add(1, std::memory_order_acquire) & closed_flag) == 0)
+		{
+			return true;
+		}
+		
+		leave();
+		return false;
+	}
+	
+	inline
+	void leave() noexcept
+	{
+		auto previous = state.fetch_sub(1, std::memory_order_acq_rel);
+		if((previous & closed_flag) == 0)
+		{
+			return;
+		}
+		
+		notify();
+		if((previous & (deferred_flag | claimed_flag | count_mask)) == (deferred_flag | 1))
+		{
+			// Last call out after a deferred close, finish the cancellation on its behalf.
+			// The gate may be gone once it has drained: nothing of it is touched afterwards.
+			try_claim();
+		}
+	}
+	
+	/// Closes the gate so that no further call is let in, and waits for in-flight calls to drain.
+	///
+	/// Calls made on the current thread are not waited for (e.g. the owner is released from inside a callback);
+	/// in that case, `drained` is called once the outermost of these calls returns.
+	inline
+	void close() noexcept
+	{
+		auto reentrancy = entered_on_this_thread();
+		auto flags = reentrancy == 0 ? closed_flag : closed_flag | deferred_flag;
+		
+		auto previous = state.load(std::memory_order_relaxed);
+		while((previous & closed_flag) == 0 && !state.compare_exchange_weak(previous, previous | flags, std::memory_order_acq_rel, std::memory_order_relaxed)) {}
+		
+		wait_for(reentrancy);
+		
+		if((previous & closed_flag) == 0 && reentrancy == 0 && drained != nullptr)
+		{
+			drained(this);
+		}
+	}
+	
+	/// Closes the gate so that no further call is let in, without waiting for in-flight calls: `drained` is called by the last of them
+	/// to return, or right away if there is none. Returns false, and does nothing, if the gate was closed already.
+	inline
+	bool close_detached() noexcept
+	{
+		auto previous = state.load(std::memory_order_relaxed);
+		while((previous & closed_flag) == 0 && !state.compare_exchange_weak(previous, previous | closed_flag | deferred_flag | detached_flag, std::memory_order_acq_rel, std::memory_order_relaxed)) {}
+		
+		if((previous & closed_flag) != 0)
+		{
+			return false;
+		}
+		
+		try_claim();
+		return true;
+	}
+	
+	inline
+	bool is_closed() const noexcept
+	{
+		return (state.load(std::memory_order_acquire) & closed_flag) != 0;
+	}
+	
+	/// Reopens a closed gate for new calls. Only valid once it has drained and nothing else refers to it anymore.
+	inline
+	void reopen() noexcept
+	{
+		state.store(0, std::memory_order_release);
+	}
+	
+	/// Whether the gate was closed by close_detached().
+	inline
+	bool is_detached() const noexcept
+	{
+		return (state.load(std::memory_order_acquire) & detached_flag) != 0;
+	}
+	
+	friend class safe_call_scope;
+	
+private:
+	static constexpr uint32_t closed_flag = 1u << 31;
+	static constexpr uint32_t deferred_flag = 1u << 30;
+	static constexpr uint32_t claimed_flag = 1u << 29;
+	static constexpr uint32_t detached_flag = 1u << 28;
+	static constexpr uint32_t count_mask = detached_flag - 1;
+	
+	inline
+	uint32_t entered_on_this_thread() const noexcept
+	{
+		uint32_t count = 0;
+		for(auto f = safe_callbacks_detail::current_call_frame; f != nullptr; f = f->previous)
+		{
+			count += f->gate == this;
+		}
+		return count;
+	}
+	
+	inline
+	void wait_for(uint32_t in_flight) noexcept
+	{
+		auto current = state.load(std::memory_order_acquire);
+		while((current & count_mask) > in_flight)
+		{
+#if __cpp_lib_atomic_wait
+			state.wait(current, std::memory_order_acquire);
+#else
+			std::this_thread::yield();
+#endif
+			current = state.load(std::memory_order_acquire);
+		}
+	}
+	
+	inline
+	void notify() noexcept
+	{
+#if __cpp_lib_atomic_wait
+		state.notify_all();
+#endif
+	}
+	
+	// Runs `drained` if no call is in flight anymore and nobody else did.
+	inline
+	void try_claim() noexcept
+	{
+		auto expected = state.load(std::memory_order_acquire);
+		while((expected & (claimed_flag | count_mask)) == 0)
+		{
+			if(state.compare_exchange_weak(expected, expected | claimed_flag, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				if(drained != nullptr)
+				{
+					drained(this);
+				}
+				return;
+			}
+		}
+	}
+	
+	std::atomic<uint32_t> state = 0;
+	void (*drained)(safe_call_gate*);
+};
+
+// Helper class. Keeps a call registered with a gate, and recorded on the current thread, for the lifetime of the scope.
+class safe_call_scope
+{
+public:
+	safe_call_scope(safe_call_gate& gate) noexcept: gate(gate), frame{&gate, safe_callbacks_detail::current_call_frame}
+	{
+		safe_callbacks_detail::current_call_frame = &frame;
+	}
+	safe_call_scope(const safe_call_scope&) = delete;
+	safe_call_scope& operator=(const safe_call_scope&) = delete;
+	~safe_call_scope()
+	{
+		safe_callbacks_detail::current_call_frame = frame.previous;
+		gate.leave();
+	}
+	
+private:
+	safe_call_gate& gate;
+	safe_callbacks_detail::call_frame frame;
+};
+
+// Helper class. Registry entry of a wrapper in its owner. The entry is embedded in the wrapper's own allocation,
+// and linked into the owner's intrusive list of entries.
+class safe_cancellable
+{
+public:
+	safe_cancellable(void (*cancel)(safe_cancellable*, bool)): cancel_hook(cancel) {}
+	safe_cancellable(const safe_cancellable&) = delete;
+	safe_cancellable& operator=(const safe_cancellable&) = delete;
+	
+	/// Cancels the entry. If `detach` is set, in-flight calls are not waited for, and the owner is told once they have returned.
+	inline
+	void cancel(bool detach = false)
+	{
+		cancel_hook(this, detach);
+	}
+	
+	friend class safe_registry_stripe;
+	friend class safe_callbacks_impl;
+	friend class local_safe_callbacks_impl;
+	
+private:
+	void (*cancel_hook)(safe_cancellable*, bool);
+	safe_cancellable* previous = nullptr;
+	safe_cancellable* next = nullptr;
+};
+
+// Reclaimers are declared in safe_callbacks_detail, so that background_reclaimer::shared() is a single instance per program.
+using safe_reclamation_task = safe_callbacks_detail::reclamation_task;
+using safe_reclaimer = safe_callbacks_detail::reclaimer;
+using safe_background_reclaimer = safe_callbacks_detail::background_reclaimer;
+
+// Helper class. A cancelled callable moved into a reclamation task, allocated from its owner's memory resource.
+template <typename F>
+class safe_reclaimed_callable final: public safe_reclamation_task
+{
+public:
+	static safe_reclaimed_callable* make(F&& callable, const std::pmr::polymorphic_allocator<std::byte>& allocator)
+	{
+		std::pmr::polymorphic_allocator<safe_reclaimed_callable> typed_allocator(allocator.resource());
+		auto allocation = typed_allocator.allocate(1);
+		try
+		{
+			return new (allocation) safe_reclaimed_callable(std::move(callable), allocator.resource());
+		}
+		catch(...)
+		{
+			typed_allocator.deallocate(allocation, 1);
+			throw;
+		}
+	}
+	
+	void reclaim() noexcept override
+	{
+		std::pmr::polymorphic_allocator<safe_reclaimed_callable> typed_allocator(resource);
+		this->~safe_reclaimed_callable();
+		typed_allocator.deallocate(this, 1);
+	}
+	
+private:
+	safe_reclaimed_callable(F&& callable, std::pmr::memory_resource* resource): callable(std::move(callable)), resource(resource) {}
+	~safe_reclaimed_callable() = default;
+	
+	F callable;
+	std::pmr::memory_resource* resource;
+};
+
+// How the wrappers of an owner are cancelled.
+enum class safe_cancellation_mode
+{
+	// Each wrapper has its own gate and registers itself with the owner, which cancels wrappers one by one on teardown.
+	per_wrapper,
+	// Wrappers do not register themselves and share the owner's gate, which is closed in one step on teardown.
+	// Cancelled callables are reclaimed when the last copy of their wrapper is released.
+	generation
+};
+
+// Activity counters of one or more owners. All counters are updated with relaxed atomic operations.
+struct safe_callbacks_statistics
+{
+	// Wrappers currently alive, cancelled or not.
+	std::atomic<int64_t> live_wrappers = 0;
+	// Calls of wrappers and posted tasks that ran their callable.
+	std::atomic<uint64_t> invocations = 0;
+	// Calls of wrappers and posted tasks that were dropped because their owner was released.
+	std::atomic<uint64_t> cancelled_invocations = 0;
+	// Time serialized calls spent waiting for another call of the same wrapper, in total and at most.
+	std::atomic<uint64_t> lock_wait_ns = 0;
+	std::atomic<uint64_t> max_lock_wait_ns = 0;
+	// Owner teardowns, and the time they took in total and at most.
+	std::atomic<uint64_t> teardowns = 0;
+	std::atomic<uint64_t> teardown_ns = 0;
+	std::atomic<uint64_t> max_teardown_ns = 0;
+};
+
+struct safe_callbacks_options
+{
+	safe_cancellation_mode mode = safe_cancellation_mode::per_wrapper;
+	// If set, cancelled callables are handed over to it instead of being destroyed on the cancelling thread.
+	// Must outlive the owner and all of its wrappers.
+	safe_reclaimer* reclaimer = nullptr;
+	// If set, the owner's registry and the state of all of its wrappers are allocated from it instead of the default resource.
+	// Must outlive the owner and all of its wrappers, and be thread safe if wrappers are created or released on several threads.
+	std::pmr::memory_resource* resource = nullptr;
+	// If set and statistics are enabled, the owner's activity is counted in it. May be shared by several owners.
+	// Must outlive the owner and all of its wrappers.
+	safe_callbacks_statistics* statistics = nullptr;
+	// If false, the owner's teardown does not wait for calls in flight: it cancels all wrappers and returns right away.
+	// Callables may then still be running after the owner is gone, and must keep alive whatever they use themselves.
+	bool wait_for_calls = true;
+	// If set, called once, after a teardown that did not wait, when the last call in flight has returned: on the thread of that call,
+	// or during the teardown if there is none. May release what the calls used, the object holding their wrappers included. Must not throw.
+	std::function<void()> on_drained;
+};
+
+// Updates the statistics of an owner with `update`, if statistics are enabled and the owner has a statistics object.
+template <typename U> inline
+void record_statistics([[maybe_unused]] const safe_callbacks_options& options, [[maybe_unused]] U&& update) noexcept
+{
+	if constexpr(safe_callbacks_config::statistics)
+	{
+		if(options.statistics != nullptr)
+		{
+			update(*options.statistics);
+		}
+	}
+}
+
+inline
+void record_max(std::atomic<uint64_t>& maximum, uint64_t value) noexcept
+{
+	auto current = maximum.load(std::memory_order_relaxed);
+	while(current < value && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+inline
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) noexcept
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Helper class. One stripe of an owner's registry: a lock and the circular list of the entries hashed to it.
+// Stripes are cache line aligned, so that threads registering with different stripes do not contend.
+class alignas(64) safe_registry_stripe
+{
+public:
+	safe_registry_stripe(): entries(nullptr)
+	{
+		entries.previous = entries.next = &entries;
+	}
+	safe_registry_stripe(const safe_registry_stripe&) = delete;
+	safe_registry_stripe& operator=(const safe_registry_stripe&) = delete;
+	
+	friend class safe_callbacks_impl;
+	friend class safe_callbacks_group_impl;
+	
+private:
+	inline
+	void remove(safe_cancellable* cancellable)
+	{
+		std::unique_lock lock(this->lock);
+		
+		// The entry must outlive its cancellation if the owner is cancelling it right now, unless that cancellation is
+		// what releases it, on this very thread (e.g. its callable held the last copy of the wrapper).
+		cancelling_changed.wait(lock, [&] { return cancelling != cancellable || cancelling_thread == std::this_thread::get_id(); });
+		
+		if(cancellable->next != nullptr)
+		{
+			unlink(cancellable);
+		}
+	}
+	
+	// Cancels every entry, one at a time and without holding the lock, so that they may register or unregister entries meanwhile.
+	inline
+	void cancel_entries(bool detach)
+	{
+		std::unique_lock lock(this->lock);
+		while(entries.next != &entries)
+		{
+			auto cancellable = entries.next;
+			unlink(cancellable);
+			cancelling = cancellable;
+			cancelling_thread = std::this_thread::get_id();
+			
+			lock.unlock();
+			cancellable->cancel(detach);
+			lock.lock();
+			
+			cancelling = nullptr;
+			cancelling_changed.notify_all();
+		}
+	}
+	
+	// Called by the cancellation of an entry once it no longer needs the entry, so that others may release it.
+	inline
+	void finish_cancelling(safe_cancellable* cancellable)
+	{
+		std::lock_guard lock(this->lock);
+		if(cancelling == cancellable && cancelling_thread == std::this_thread::get_id())
+		{
+			cancelling = nullptr;
+			cancelling_changed.notify_all();
+		}
+	}
+	
+	inline
+	void link(safe_cancellable* cancellable)
+	{
+		cancellable->previous = &entries;
+		cancellable->next = entries.next;
+		entries.next->previous = cancellable;
+		entries.next = cancellable;
+	}
+	
+	inline
+	void unlink(safe_cancellable* cancellable)
+	{
+		cancellable->previous->next = cancellable->next;
+		cancellable->next->previous = cancellable->previous;
+		cancellable->previous = cancellable->next = nullptr;
+	}
+	
+	std::mutex lock;
+	// Sentinel of the circular list of registered entries.
+	safe_cancellable entries;
+	safe_cancellable* cancelling = nullptr;
+	std::thread::id cancelling_thread;
+	std::condition_variable cancelling_changed;
+};
+
+class safe_callbacks_impl;
+
+// Helper class. The gate of an owner, shared by its posted tasks, resumed coroutines, signal subscribers and generation mode wrappers.
+class safe_owner_gate: public safe_call_gate
+{
+public:
+	safe_owner_gate(safe_callbacks_impl* owner): safe_call_gate(&drained), owner(owner) {}
+	
+private:
+	static void drained(safe_call_gate* gate);
+	
+	safe_callbacks_impl* owner;
+};
+
+// Helper class. Instances of this class may be released after the main safe_callbacks instance is released,
+// but it will be marked as is_cancelled=true and all registered callables will be cancelled.
+class safe_callbacks_impl
+{
+public:
+	safe_callbacks_impl(const safe_callbacks_options& options = {}): options(options), gate(this) {}
+	safe_callbacks_impl(const safe_callbacks_impl&) = delete;
+	safe_callbacks_impl& operator=(const safe_callbacks_impl&) = delete;
+	
+	/// Allocates an owner's registry, from the memory resource of its options.
+	static std::shared_ptr<safe_callbacks_impl> make(const safe_callbacks_options& options)
+	{
+		return std::allocate_shared<safe_callbacks_impl>(allocator_for(options), options);
+	}
+	
+	inline
+	void add_cancellable(safe_cancellable* cancellable)
+	{
+		if(!is_cancelled)
+		{
+			safe_tracer::trace(safe_trace_event::cancellable_added);
+			auto& stripe = stripe_of(cancellable);
+			std::lock_guard lock(stripe.lock);
+			
+			if(!is_cancelled)
+			{
+				stripe.link(cancellable);
+				return;
+			}
+		}
+		
+		cancellable->cancel();
+	}
+	
+	/// Registers several entries at once, taking the lock of each stripe they fall into only once.
+	template <std::size_t N> inline
+	void add_cancellables(const std::array<safe_cancellable*, N>& cancellables)
+	{
+		std::array<bool, N> linked{};
+		if(!is_cancelled)
+		{
+			std::array<std::size_t, N> indices;
+			for(std::size_t i = 0; i < N; i++)
+			{
+				safe_tracer::trace(safe_trace_event::cancellable_added);
+				indices[i] = stripe_index_of(cancellables[i]);
+			}
+			
+			for(std::size_t index = 0; index < SAFE_CALLBACKS_REGISTRY_STRIPES; index++)
+			{
+				if(std::find(indices.begin(), indices.end(), index) == indices.end())
+				{
+					continue;
+				}
+				
+				auto& stripe = stripes[index];
+				std::lock_guard lock(stripe.lock);
+				if(is_cancelled)
+				{
+					break;
+				}
+				for(std::size_t i = 0; i < N; i++)
+				{
+					if(indices[i] == index)
+					{
+						stripe.link(cancellables[i]);
+						linked[i] = true;
+					}
+				}
+			}
+		}
+		
+		// Entries which could not be linked before the owner was cancelled cancel themselves, as in add_cancellable().
+		for(std::size_t i = 0; i < N; i++)
+		{
+			if(!linked[i])
+			{
+				cancellables[i]->cancel();
+			}
+		}
+	}
+	
+	inline
+	void remove_cancellable(safe_cancellable* cancellable)
+	{
+		safe_tracer::trace(safe_trace_event::cancellable_removed);
+		stripe_of(cancellable).remove(cancellable);
+	}
+	
+	/// Tells the owner that the cancellation of `cancellable`, running on this thread, does not need it anymore.
+	inline
+	void finish_cancelling(safe_cancellable* cancellable)
+	{
+		stripe_of(cancellable).finish_cancelling(cancellable);
+	}
+	
+	/// Marks the owner as cancelled and cancels every registered entry, exactly once.
+	///
+	/// Entries are cancelled one at a time, without holding any lock, so callbacks still in flight
+	/// may create or release wrappers of this owner while they are drained.
+	///
+	/// With `on_drained`, calls in flight are not waited for, whatever the options: `on_drained` is called once they have returned.
+	inline
+	void cancel_all(std::function<void()>&& on_drained = nullptr)
+	{
+		[[maybe_unused]] std::chrono::steady_clock::time_point start;
+		if constexpr(safe_callbacks_config::statistics)
+		{
+			start = std::chrono::steady_clock::now();
+		}
+		
+		auto detach = !options.wait_for_calls || on_drained != nullptr;
+		drained_handler = std::move(on_drained);
+		
+		// Entries registering after this point cancel themselves, so each stripe only needs to be drained once.
+		is_cancelled = true;
+		
+		// In generation mode, this stops and drains every wrapper of the owner at once.
+		if(detach)
+		{
+			this->detach(gate);
+		}
+		else
+		{
+			gate.close();
+		}
+		
+		for(auto& stripe : stripes)
+		{
+			stripe.cancel_entries(detach);
+		}
+		
+		record_statistics(options, [&](auto& statistics) {
+			auto duration = elapsed_ns(start);
+			statistics.teardowns.fetch_add(1, std::memory_order_relaxed);
+			statistics.teardown_ns.fetch_add(duration, std::memory_order_relaxed);
+			record_max(statistics.max_teardown_ns, duration);
+		});
+		
+		if(detach)
+		{
+			// Every gate is closed, the last of them to drain completes the teardown.
+			detached_gate_drained();
+		}
+	}
+	
+	/// Closes `gate` without waiting for its calls in flight, on behalf of a teardown that does not wait.
+	inline
+	void detach(safe_call_gate& gate) noexcept
+	{
+		pending_gates.fetch_add(1, std::memory_order_relaxed);
+		if(!gate.close_detached())
+		{
+			detached_gate_drained();
+		}
+	}
+	
+	/// Called once a gate closed by detach() has drained. Callers keep the owner alive, as the handlers may release everything else,
+	/// the wrapper whose call has just returned included: leaving the gate is that call's last access to the wrapper's state.
+	inline
+	void detached_gate_drained() noexcept
+	{
+		if(pending_gates.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			if(options.on_drained)
+			{
+				options.on_drained();
+			}
+			if(auto handler = std::exchange(drained_handler, nullptr))
+			{
+				handler();
+			}
+		}
+	}
+	
+	/// Re-arms a cancelled owner for new wrappers, reusing its storage. Only valid once nothing else refers to it anymore.
+	inline
+	void rearm() noexcept
+	{
+		gate.reopen();
+		pending_gates.store(1, std::memory_order_relaxed);
+		is_cancelled.store(false, std::memory_order_release);
+	}
+	
+	/// The allocator of the owner's wrappers.
+	inline
+	std::pmr::polymorphic_allocator<std::byte> allocator() const noexcept
+	{
+		return allocator_for(options);
+	}
+	
+	const safe_callbacks_options options;
+	std::atomic<bool> is_cancelled = false;
+	// Shared by all wrappers of the owner in generation mode.
+	safe_owner_gate gate;
+	
+private:
+	static std::pmr::polymorphic_allocator<std::byte> allocator_for(const safe_callbacks_options& options) noexcept
+	{
+		return options.resource != nullptr ? options.resource : std::pmr::get_default_resource();
+	}
+	
+	// Entries are spread over the stripes by address, so that any thread can find the stripe of an entry.
+	static inline
+	std::size_t stripe_index_of(const safe_cancellable* cancellable) noexcept
+	{
+		auto hash = (reinterpret_cast<uintptr_t>(cancellable) >> 4) * UINT64_C(0x9E3779B97F4A7C15);
+		return (hash >> 32) % SAFE_CALLBACKS_REGISTRY_STRIPES;
+	}
+	
+	inline
+	safe_registry_stripe& stripe_of(const safe_cancellable* cancellable) noexcept
+	{
+		return stripes[stripe_index_of(cancellable)];
+	}
+	
+	safe_registry_stripe stripes[SAFE_CALLBACKS_REGISTRY_STRIPES];
+	// Gates closed by a teardown that does not wait and still draining, plus one for the teardown itself until it is done.
+	std::atomic<uint32_t> pending_gates = 1;
+	// Called once the current teardown has drained, on behalf of safe_callbacks::cancel_async().
+	std::function<void()> drained_handler;
+};
+
+inline
+void safe_owner_gate::drained(safe_call_gate* gate)
+{
+	if(gate->is_detached())
+	{
+		static_cast<safe_owner_gate*>(gate)->owner->detached_gate_drained();
+	}
+}
+
+// Helper class. A cancellation group: wrappers made through it share its gate instead of being registered one by one,
+// so that they are all cancelled at once, in constant time. The group itself is registered with its parent, the owner or
+// an enclosing group, and is cancelled along with it. It is allocated from the owner's memory resource.
+class safe_callbacks_group_impl: public safe_cancellable
+{
+public:
+	safe_callbacks_group_impl(const std::shared_ptr<safe_callbacks_impl>& owner, const std::shared_ptr<safe_callbacks_group_impl>& parent):
+	safe_cancellable(&cancel), owner(owner), parent(parent), gate(owner.get())
+	{}
+	safe_callbacks_group_impl(const safe_callbacks_group_impl&) = delete;
+	safe_callbacks_group_impl& operator=(const safe_callbacks_group_impl&) = delete;
+	~safe_callbacks_group_impl()
+	{
+		unregister();
+	}
+	
+	static std::shared_ptr<safe_callbacks_group_impl> make(const std::shared_ptr<safe_callbacks_impl>& owner, const std::shared_ptr<safe_callbacks_group_impl>& parent)
+	{
+		auto group = std::allocate_shared<safe_callbacks_group_impl>(owner->allocator(), owner, parent);
+		if(parent != nullptr)
+		{
+			parent->add_child(group.get());
+		}
+		else
+		{
+			owner->add_cancellable(group.get());
+		}
+		return group;
+	}
+	
+	/// Cancels the group and its subgroups on its own.
+	///
+	/// The group stays registered with its parent until it is released, so that the owner's teardown still waits for calls of its
+	/// wrappers in flight: it may be cancelled from inside one of them, which keeps running once this returns.
+	inline
+	void cancel_group()
+	{
+		cancel_all(false);
+	}
+	
+	const std::shared_ptr<safe_callbacks_impl> owner;
+	// Keeps the registry of an enclosing group alive, as `owner` does for the owner's.
+	const std::shared_ptr<safe_callbacks_group_impl> parent;
+	// Shared by all wrappers of the group.
+	safe_owner_gate gate;
+	
+private:
+	static void cancel(safe_cancellable* cancellable, bool detach)
+	{
+		static_cast<safe_callbacks_group_impl*>(cancellable)->cancel_all(detach);
+	}
+	
+	inline
+	void cancel_all(bool detach)
+	{
+		// Subgroups registering after the gate is closed cancel themselves.
+		if(detach)
+		{
+			owner->detach(gate);
+		}
+		else
+		{
+			gate.close();
+		}
+		children.cancel_entries(detach);
+	}
+	
+	inline
+	void add_child(safe_cancellable* child)
+	{
+		{
+			std::lock_guard lock(children.lock);
+			if(!gate.is_closed())
+			{
+				children.link(child);
+				return;
+			}
+		}
+		child->cancel();
+	}
+	
+	inline
+	void unregister()
+	{
+		if(parent != nullptr)
+		{
+			parent->children.remove(this);
+		}
+		else
+		{
+			owner->remove_cancellable(this);
+		}
+	}
+	
+	// Registry of the subgroups.
+	safe_registry_stripe children;
+};
+
+// Invocation policies. With the concurrent policy, simultaneous calls of a wrapper run the callable in parallel.
+// With the serialized policy, the callable runs on one thread at a time; re-entrant calls from the same thread are allowed.
+// With the once policy, only the first call runs the callable, which is released, and unregistered, as soon as it returns.
+// Under all policies, no call starts running the callable once the wrapper has been cancelled.
+struct concurrent_invocation
+{
+	struct lock_type
+	{
+		inline void lock() noexcept {}
+		inline void unlock() noexcept {}
+	};
+};
+
+struct serialized_invocation
+{
+	using lock_type = std::recursive_mutex;
+};
+
+struct once_invocation
+{
+	// Calls of a once wrapper never wait for each other: all but the first one are dropped.
+	struct lock_type
+	{
+		inline void lock() noexcept {}
+		inline void unlock() noexcept {}
+		
+		/// Returns true for the first call only.
+		inline
+		bool claim() noexcept
+		{
+			return !claimed.exchange(true, std::memory_order_acq_rel);
+		}
+		
+		std::atomic<bool> claimed = false;
+	};
+};
+
+// Acquires the invocation lock of a wrapper. If statistics are enabled, time spent waiting for a contended lock is recorded.
+template <typename L> inline
+void lock_invocation(L& lock, [[maybe_unused]] const safe_callbacks_options& options)
+{
+	if constexpr(safe_callbacks_config::statistics && std::is_same_v<L, serialized_invocation::lock_type>)
+	{
+		if(options.statistics != nullptr)
+		{
+			// Uncontended locks are not timed.
+			if(lock.try_lock())
+			{
+				return;
+			}
+			
+			auto start = std::chrono::steady_clock::now();
+			lock.lock();
+			
+			auto wait = elapsed_ns(start);
+			options.statistics->lock_wait_ns.fetch_add(wait, std::memory_order_relaxed);
+			record_max(options.statistics->max_lock_wait_ns, wait);
+			return;
+		}
+	}
+	
+	lock.lock();
+}
+
+template <typename P>
+struct is_invocation_policy : std::disjunction<std::is_same<P, concurrent_invocation>, std::is_same<P, serialized_invocation>, std::is_same<P, once_invocation>> {};
+template <typename P>
+static inline constexpr bool is_invocation_policy_v = is_invocation_policy<P>::value;
+
+template <typename F>
+struct function_signature;
+template <typename R, typename ...Args>
+struct function_signature<std::function<R(Args...)>>
+{
+	using type = R(Args...);
+	using result_type = R;
+};
+
+// The signature of a callable, as deduced by std::function's deduction guides.
+template <typename C>
+using callable_signature = function_signature<decltype(std::function{std::declval<C>()})>;
+
+// The result of try_invoke(): whether the call ran for callables returning void, the optional result otherwise.
+template <typename R>
+using try_invoke_result_t = std::conditional_t<std::is_void_v<R>, bool, std::optional<R>>;
+
+// Helper class. Exclusive ownership of the state of a unique wrapper, allocated from its owner's memory resource.
+// Unlike std::unique_ptr, converting to a handle of a base type keeps destroying the object allocated.
+template <typename T>
+class safe_unique_handle
+{
+public:
+	safe_unique_handle() noexcept = default;
+	safe_unique_handle(const safe_unique_handle&) = delete;
+	safe_unique_handle& operator=(const safe_unique_handle&) = delete;
+	template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+	safe_unique_handle(safe_unique_handle<U>&& other) noexcept: pointer(std::exchange(other.pointer, nullptr)), destroy(other.destroy), resource(other.resource) {}
+	safe_unique_handle& operator=(safe_unique_handle&& other) noexcept
+	{
+		if(this != &other)
+		{
+			reset();
+			pointer = std::exchange(other.pointer, nullptr);
+			destroy = other.destroy;
+			resource = other.resource;
+		}
+		return *this;
+	}
+	~safe_unique_handle()
+	{
+		reset();
+	}
+	
+	template <typename ...A>
+	static safe_unique_handle make(const std::pmr::polymorphic_allocator<std::byte>& allocator, A&&... args)
+	{
+		std::pmr::polymorphic_allocator<T> typed_allocator(allocator.resource());
+		auto allocation = typed_allocator.allocate(1);
+		
+		safe_unique_handle handle;
+		try
+		{
+			handle.pointer = new (allocation) T(std::forward<A>(args)...);
+		}
+		catch(...)
+		{
+			typed_allocator.deallocate(allocation, 1);
+			throw;
+		}
+		handle.destroy = [](safe_call_gate* gate, std::pmr::memory_resource* resource) {
+			auto object = static_cast<T*>(gate);
+			object->~T();
+			std::pmr::polymorphic_allocator<T>(resource).deallocate(object, 1);
+		};
+		handle.resource = allocator.resource();
+		return handle;
+	}
+	
+	inline
+	T* get() const noexcept
+	{
+		return pointer;
+	}
+	
+	inline
+	T* operator->() const noexcept
+	{
+		return pointer;
+	}
+	
+	inline
+	void reset() noexcept
+	{
+		if(auto object = std::exchange(pointer, nullptr); object != nullptr)
+		{
+			destroy(object, resource);
+		}
+	}
+	
+	template <typename>
+	friend class safe_unique_handle;
+	
+private:
+	T* pointer = nullptr;
+	void (*destroy)(safe_call_gate*, std::pmr::memory_resource*) = nullptr;
+	std::pmr::memory_resource* resource = nullptr;
+};
+
+// Ownership of the state of wrappers. With shared ownership, copies of a wrapper share its state through a reference count.
+// With unique ownership, wrappers are move-only and own their state exclusively, without any reference counting.
+//
+// A `pin` keeps the state alive for the duration of a once call, whose callable may be released before the call leaves its gate,
+// and with it the last copy of the wrapper (e.g. `object → wrapper → callable → shared_ptr<object>`). Unique wrappers have
+// no other copy to fall back on, so their pins do nothing, and their callables must not own them.
+struct shared_ownership
+{
+	template <typename T>
+	using handle = std::shared_ptr<T>;
+	template <typename T>
+	using pin = std::shared_ptr<T>;
+	
+	template <typename T, typename ...A> static inline
+	handle<T> make(const std::pmr::polymorphic_allocator<std::byte>& allocator, A&&... args)
+	{
+		return std::allocate_shared<T>(allocator, std::forward<A>(args)...);
+	}
+};
+
+struct unique_ownership
+{
+	template <typename T>
+	using handle = safe_unique_handle<T>;
+	template <typename T>
+	struct pin
+	{
+		template <typename H>
+		pin(const H&) noexcept {}
+	};
+	
+	template <typename T, typename ...A> static inline
+	handle<T> make(const std::pmr::polymorphic_allocator<std::byte>& allocator, A&&... args)
+	{
+		return safe_unique_handle<T>::make(allocator, std::forward<A>(args)...);
+	}
+};
+
+// `Callable` is the concrete type of the wrapped callable, or void for a type-erased wrapper.
+template <typename DVR, typename Signature, typename Policy = serialized_invocation, typename Callable = void, typename Ownership = shared_ownership>
+class safe_function_wrapper;
+
+// Helper class. The default return value of a wrapper. Empty if it has none or if it is made by a stateless factory,
+// so that wrappers deriving from it carry nothing.
+template <typename DVR, bool Factory = is_default_factory_v<DVR>>
+class safe_default_value
+{
+public:
+	safe_default_value(DVR&& default_return_value): default_return_value(std::forward<DVR>(default_return_value)) {}
+	
+	DVR default_return_value;
+};
+
+template <>
+class safe_default_value<void, false>
+{
+public:
+	safe_default_value(std::monostate) noexcept {}
+};
+
+template <typename DVR>
+class safe_default_value<DVR, true>: private std::remove_cv_t<std::remove_reference_t<DVR>>
+{
+public:
+	safe_default_value(DVR&& factory): std::remove_cv_t<std::remove_reference_t<DVR>>(std::forward<DVR>(factory)) {}
+	
+	/// Makes a fresh default return value.
+	inline
+	default_result_t<DVR> make_default_return_value() const
+	{
+		return std::remove_cv_t<std::remove_reference_t<DVR>>::operator()();
+	}
+};
+
+// Helper class. The invocation lock of a wrapper. Stateless locks, which only the concurrent policy has, are shared by all
+// wrappers instead of taking room in each.
+template <typename L, bool Stateless = std::is_empty_v<L>>
+class safe_invocation_lock
+{
+public:
+	L invocation_lock;
+};
+
+template <typename L>
+class safe_invocation_lock<L, true>
+{
+public:
+	static inline L invocation_lock;
+};
+
+// Helper class. What a call reads before reaching the callable: the gate it goes through and the function invoking it.
+// Placed right after the wrapper's own gate, so that a call's loads share the first cache line of the wrapper's state.
+template <typename F>
+class safe_call_route
+{
+public:
+	safe_call_route(safe_call_gate& gate, F invoke) noexcept: gate(gate), invoke(invoke) {}
+	
+	// The gate calls go through: the wrapper's own, its owner's in generation mode, or its cancellation group's.
+	safe_call_gate& gate;
+	F invoke;
+};
+
+template<typename DVR, typename Policy, typename R, typename ...Args>
+class safe_function_wrapper_impl;
+
+// Helper class. The cold part of a wrapper's state, stored after its callable: the invocation lock, which only serialized and
+// once calls take, then what only registration, cancellation and cancelled calls need.
+template<typename DVR, typename Policy, typename R, typename ...Args>
+class safe_function_wrapper_tail: public safe_invocation_lock<typename Policy::lock_type>,
+								  public safe_cancellable,
+								  public safe_default_value<DVR>,
+								  public safe_wrapper_name<>
+{
+public:
+	safe_function_wrapper_tail(safe_function_wrapper_impl<DVR, Policy, R, Args...>& wrapper,
+							   default_value_t<DVR>&& default_return_value,
+							   const std::shared_ptr<safe_callbacks_impl>& owner,
+							   safe_wrapper_name<>&& name):
+	safe_cancellable(&cancel), safe_default_value<DVR>(std::forward<default_value_t<DVR>>(default_return_value)), safe_wrapper_name<>(std::move(name)), wrapper(wrapper), owner(owner)
+	{
+		record_statistics(owner->options, [](auto& statistics) { statistics.live_wrappers.fetch_add(1, std::memory_order_relaxed); });
+	}
+	safe_function_wrapper_tail(const safe_function_wrapper_tail&) = delete;
+	safe_function_wrapper_tail& operator=(const safe_function_wrapper_tail&) = delete;
+	~safe_function_wrapper_tail()
+	{
+		record_statistics(owner->options, [](auto& statistics) { statistics.live_wrappers.fetch_sub(1, std::memory_order_relaxed); });
+		owner.reset();
+	}
+	
+	// The hot part of the state, which the registry entry cancels.
+	safe_function_wrapper_impl<DVR, Policy, R, Args...>& wrapper;
+	// Keeps the owner's registry alive, so that unregistering always synchronizes with the owner's teardown.
+	std::shared_ptr<safe_callbacks_impl> owner;
+	
+private:
+	static void cancel(safe_cancellable* cancellable, bool detach)
+	{
+		auto tail = static_cast<safe_function_wrapper_tail*>(cancellable);
+		safe_tracer::trace(safe_trace_event::wrapper_cancelled, tail->name());
+		if(detach)
+		{
+			tail->owner->detach(tail->wrapper);
+		}
+		else
+		{
+			tail->wrapper.close();
+		}
+	}
+};
+
+// Helper class. The hot part of the state shared by all copies of a wrapper: its gate and call route, which is all a call reads
+// before reaching the callable. The callable follows it in safe_function_wrapper_storage, and the tail follows the callable,
+// so that a call's loads, the callable's included, share the first cache line of the wrapper's state.
+template<typename DVR, typename Policy, typename R, typename ...Args>
+class safe_function_wrapper_impl: public safe_call_gate,
+								  public safe_call_route<R (*)(safe_function_wrapper_impl<DVR, Policy, R, Args...>*, Args&&...)>
+{
+public:
+	using tail_type = safe_function_wrapper_tail<DVR, Policy, R, Args...>;
+	
+	safe_function_wrapper_impl(R (*invoke)(safe_function_wrapper_impl*, Args&&...),
+							   void (*drained)(safe_call_gate*),
+							   tail_type& tail,
+							   const std::shared_ptr<safe_callbacks_impl>& owner,
+							   safe_call_gate* group_gate):
+	safe_call_gate(drained), safe_call_route<R (*)(safe_function_wrapper_impl*, Args&&...)>(gate_for(owner, group_gate, *this), invoke), tail(tail)
+	{}
+	safe_function_wrapper_impl() = delete;
+	safe_function_wrapper_impl(const safe_function_wrapper_impl&) = delete;
+	safe_function_wrapper_impl& operator=(const safe_function_wrapper_impl&) = delete;
+	
+	using safe_call_route<R (*)(safe_function_wrapper_impl*, Args&&...)>::gate;
+	// The cold part of the state, stored after the callable.
+	tail_type& tail;
+	
+	inline
+	void add_cancel()
+	{
+		if(is_registered())
+		{
+			tail.owner->add_cancellable(&tail);
+		}
+	}
+	
+	/// Closes a once wrapper whose single call has returned, from inside that call: the callable is released, and the wrapper
+	/// unregistered, once the call has left its gate. In generation mode, the wrapper's own gate is not used by calls, and closing
+	/// it releases the callable right away.
+	inline
+	void release_once()
+	{
+		safe_call_gate::close();
+	}
+	
+protected:
+	~safe_function_wrapper_impl() = default;
+	
+	inline
+	bool is_registered() const
+	{
+		return &gate == static_cast<const safe_call_gate*>(this);
+	}
+	
+	static inline
+	safe_call_gate& gate_for(const std::shared_ptr<safe_callbacks_impl>& owner, safe_call_gate* group_gate, safe_call_gate& own) noexcept
+	{
+		if(group_gate != nullptr)
+		{
+			return *group_gate;
+		}
+		if(owner->options.mode == safe_cancellation_mode::generation)
+		{
+			return owner->gate;
+		}
+		return own;
+	}
+	
+	inline
+	void remove_cancel()
+	{
+		if(is_registered())
+		{
+			tail.owner->remove_cancellable(&tail);
+		}
+	}
+	
+	inline
+	void finish_cancel()
+	{
+		if(is_registered())
+		{
+			tail.owner->finish_cancelling(&tail);
+		}
+	}
+};
+
+// Helper class. Stores the callable of a wrapper by value, between the hot and the cold parts of its state.
+// Callables of any size live in the wrapper's single allocation; there is no separate buffer and no heap fallback.
+// With SAFE_CALLBACKS_PADDED_WRAPPERS, the storage is aligned and sized to whole cache lines.
+template<typename F, typename DVR, typename Policy, typename R, typename ...Args>
+class alignas(std::max({safe_callbacks_config::padded_wrappers ? std::size_t(64) : std::size_t(1), alignof(F), alignof(safe_function_wrapper_impl<DVR, Policy, R, Args...>), alignof(safe_function_wrapper_tail<DVR, Policy, R, Args...>)})) safe_function_wrapper_storage: public safe_function_wrapper_impl<DVR, Policy, R, Args...>
+{
+	using tail_type = safe_function_wrapper_tail<DVR, Policy, R, Args...>;
+	
+public:
+	template <typename C>
+	safe_function_wrapper_storage(C&& callable, default_value_t<DVR>&& default_return_value, const std::shared_ptr<safe_callbacks_impl>& owner, safe_wrapper_name<>&& name, safe_call_gate* group_gate = nullptr):
+	safe_function_wrapper_impl<DVR, Policy, R, Args...>(&invoke, &drained, tail_state, owner, group_gate), callable(std::in_place, std::forward<C>(callable)), tail_state(*this, std::forward<default_value_t<DVR>>(default_return_value), owner, std::move(name))
+	{}
+	~safe_function_wrapper_storage()
+	{
+		safe_tracer::trace(safe_trace_event::wrapper_destroyed, tail_state.name());
+		// Unregister first, the owner might be cancelling this wrapper right now.
+		this->remove_cancel();
+		
+		if(this->gate.is_closed())
+		{
+			// Lazily reclaimed in generation mode.
+			reclaim();
+		}
+		callable.reset();
+	}
+	
+	template <typename ...A> inline
+	R call(A&&... args)
+	{
+		return (*callable)(std::forward<A>(args)...);
+	}
+	
+private:
+	static R invoke(safe_function_wrapper_impl<DVR, Policy, R, Args...>* impl, Args&&... args)
+	{
+		return static_cast<safe_function_wrapper_storage*>(impl)->call(std::forward<Args>(args)...);
+	}
+	
+	// Called once the wrapper has been cancelled and no call is in flight anymore.
+	// The wrapper may be gone once its callable is reclaimed, so nothing of it is touched afterwards.
+	static void drained(safe_call_gate* gate)
+	{
+		auto storage = static_cast<safe_function_wrapper_storage*>(gate);
+		if(gate->is_detached())
+		{
+			// Reclaiming may release the wrapper, and its reference to the owner.
+			auto owner = storage->tail_state.owner;
+			storage->reclaim();
+			owner->detached_gate_drained();
+		}
+		else
+		{
+			storage->reclaim();
+		}
+	}
+	
+	// Releases the callable. It is moved out and destroyed last, once the owner has been told that this wrapper's cancellation
+	// is done with it: the callable may hold the last copy of the wrapper (e.g. `op → handler → callable → shared_ptr<op>`).
+	inline
+	void reclaim()
+	{
+		if constexpr(std::is_same_v<Policy, once_invocation>)
+		{
+			// A once wrapper closed by its own call is still registered. Unregistering waits for a cancellation of the owner
+			// in progress, which waits for that call to have left the gate, so it is not done before.
+			this->remove_cancel();
+		}
+		
+		if constexpr(std::is_move_constructible_v<F>)
+		{
+			if(!callable.has_value())
+			{
+				return;
+			}
+			
+			std::optional<F> released;
+			if(auto reclaimer = tail_state.owner->options.reclaimer; reclaimer != nullptr)
+			{
+				reclaimer->post(safe_reclaimed_callable<F>::make(std::move(*callable), tail_state.owner->allocator()));
+			}
+			else
+			{
+				released.emplace(std::move(*callable));
+			}
+			callable.reset();
+			this->finish_cancel();
+		}
+		else
+		{
+			callable.reset();
+		}
+	}
+	
+	std::optional<F> callable;
+	tail_type tail_state;
+};
+
+// Helper class. One wrapper's state in a batch, indexed so that wrappers of the same type can be batched together.
+template <std::size_t I, typename T>
+struct safe_batch_element
+{
+	template <typename ...A>
+	safe_batch_element(A&&... args): element(std::forward<A>(args)...) {}
+	
+	T element;
+};
+
+// The state and wrapper types make_safe() uses for a callable of type `C`.
+template <typename Policy, typename C, typename Signature = typename callable_signature<C>::type>
+struct safe_batch_entry;
+template <typename Policy, typename C, typename R, typename ...Args>
+struct safe_batch_entry<Policy, C, R(Args...)>
+{
+	using storage_type = safe_function_wrapper_storage<std::decay_t<C>, void, Policy, R, Args...>;
+	using wrapper_type = safe_function_wrapper<void, R(Args...), Policy, std::decay_t<C>>;
+};
+
+// Helper class. The states of wrappers created together by make_safe_all(), laid out contiguously in a single allocation.
+template <typename Indices, typename ...T>
+class safe_wrapper_batch;
+template <std::size_t ...I, typename ...T>
+class safe_wrapper_batch<std::index_sequence<I...>, T...>: public safe_batch_element<I, T>...
+{
+public:
+	template <typename ...C>
+	safe_wrapper_batch(const std::shared_ptr<safe_callbacks_impl>& owner, C&&... callables):
+	safe_batch_element<I, T>(std::forward<C>(callables), std::monostate{}, owner, safe_wrapper_name<>(""))...
+	{}
+	
+	template <std::size_t Index> inline
+	auto& get() noexcept
+	{
+		return static_cast<safe_batch_element<Index, std::tuple_element_t<Index, std::tuple<T...>>>&>(*this).element;
+	}
+};
+
+template<typename DVR, typename Policy, typename Callable, typename Ownership, typename R, typename ...Args>
+class safe_function_wrapper<DVR, R(Args...), Policy, Callable, Ownership>
+{
+	using storage_type = safe_function_wrapper_storage<Callable, DVR, Policy, R, Args...>;
+	using impl_type = std::conditional_t<std::is_void_v<Callable>, safe_function_wrapper_impl<DVR, Policy, R, Args...>, storage_type>;
+	
+public:
+	template <typename C>
+	safe_function_wrapper(C&& callable, default_value_t<DVR>&& default_return_value, const std::shared_ptr<safe_callbacks_impl>& owner, safe_wrapper_name<>&& name, safe_call_gate* group_gate = nullptr)
+	{
+		using concrete_storage_type = safe_function_wrapper_storage<std::decay_t<C>, DVR, Policy, R, Args...>;
+		static_assert(std::is_void_v<Callable> || std::is_same_v<concrete_storage_type, storage_type>, "Callable type mismatch");
+		
+		// The callable, its state and its registry entry share a single allocation, from the owner's memory resource.
+		impl = Ownership::template make<concrete_storage_type>(owner->allocator(), std::forward<C>(callable), std::forward<default_value_t<DVR>>(default_return_value), owner, std::move(name), group_gate);
+		impl->add_cancel();
+	}
+	
+	/// Converts a wrapper of a concrete callable type to a type-erased wrapper sharing (or, for unique wrappers, taking over) the same state.
+	/// Does not allocate.
+	template <typename C, typename = std::enable_if_t<std::is_void_v<Callable> && !std::is_void_v<C> && std::is_same_v<Ownership, shared_ownership>>>
+	safe_function_wrapper(const safe_function_wrapper<DVR, R(Args...), Policy, C, Ownership>& other): impl(other.impl) {}
+	template <typename C, typename = std::enable_if_t<std::is_void_v<Callable> && !std::is_void_v<C>>>
+	safe_function_wrapper(safe_function_wrapper<DVR, R(Args...), Policy, C, Ownership>&& other): impl(std::move(other.impl)) {}
+	
+	/// Calls the wrapped callable, forwarding `args` the way std::function::operator() would. Arguments of another type than
+	/// their parameter are converted once, right into the parameters of callables of wrappers typed after their callable.
+	template <typename ...A, typename = std::enable_if_t<is_forwardable_args_v<type_list<A...>, type_list<Args...>>>> inline
+	R operator()(A&&... args) const
+	{
+		return invoke_or<R>([this](bool cancelled) -> R {
+			if constexpr(std::is_same_v<Policy, once_invocation>)
+			{
+				if(!cancelled)
+				{
+					return repeated_return_value();
+				}
+			}
+			return cancelled_return_value();
+		}, std::forward<A>(args)...);
+	}
+	
+	/// Calls the wrapped callable with arguments of the parameters' own types, so that braced initializer lists and null
+	/// pointer constants can be passed, as to std::function::operator(). They are taken by reference, and forwarded without
+	/// an extra copy or move.
+	inline
+	R operator()(Args&&... args) const
+	{
+		return operator()<Args...>(std::forward<Args>(args)...);
+	}
+	
+	/// Calls the wrapped callable like operator(), unless the wrapper is not alive anymore. Returns the result of the call,
+	/// or an empty optional if it was dropped; for callables returning void, whether the call ran.
+	template <typename ...A, typename = std::enable_if_t<is_forwardable_args_v<type_list<A...>, type_list<Args...>>>> inline
+	try_invoke_result_t<R> try_invoke(A&&... args) const
+	{
+		return invoke_or<try_invoke_result_t<R>>([this](bool) { record_ignored(); return try_invoke_result_t<R>{}; }, std::forward<A>(args)...);
+	}
+	
+	/// Calls the wrapped callable like try_invoke() above, with arguments of the parameters' own types.
+	inline
+	try_invoke_result_t<R> try_invoke(Args&&... args) const
+	{
+		return try_invoke<Args...>(std::forward<Args>(args)...);
+	}
+	
+	/// Whether calls of the wrapper still run its callable: false once it has been cancelled, or for a once wrapper, called.
+	/// A single load, without locking, so that callers may skip building the arguments of calls that would be dropped.
+	/// The answer may be outdated as soon as it is returned, if the owner is being released concurrently.
+	inline
+	bool is_alive() const noexcept
+	{
+		if constexpr(std::is_same_v<Policy, once_invocation>)
+		{
+			if(impl->tail.invocation_lock.claimed.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+		}
+		return !impl->gate.is_closed();
+	}
+	
+	/// Adopts state constructed elsewhere, and registered with its owner already (e.g. by make_safe_all()).
+	explicit safe_function_wrapper(typename Ownership::template handle<impl_type>&& impl): impl(std::move(impl)) {}
+	
+	template <typename, typename, typename, typename, typename>
+	friend class safe_function_wrapper;
+	
+private:
+	// Runs the callable, or returns `dropped(cancelled)` if the call is dropped: `cancelled` is false for the calls of a once
+	// wrapper after the first one. `Result` is the callable's return type, or the result type of try_invoke().
+	template <typename Result, typename D, typename ...A> inline
+	Result invoke_or(D&& dropped, A&&... args) const
+	{
+		if constexpr(std::is_same_v<Policy, once_invocation>)
+		{
+			if(!impl->tail.invocation_lock.claim())
+			{
+				return dropped(false);
+			}
+		}
+		
+		// Only once calls pin the state, see once_release: other calls leave their gate last, and finishing a cancellation
+		// which releases the last copy of the wrapper touches nothing of it afterwards.
+		using pin_type = std::conditional_t<std::is_same_v<Policy, once_invocation>, typename Ownership::template pin<impl_type>, unique_ownership::pin<impl_type>>;
+		[[maybe_unused]] pin_type pin(impl);
+		
+		if constexpr(std::is_same_v<Policy, serialized_invocation>)
+		{
+			// Calls of a dead wrapper are dropped without waiting for the turn of calls still in flight.
+			if(impl->gate.is_closed())
+			{
+				return dropped(true);
+			}
+		}
+		
+		// Serialized calls wait for their turn before entering the gate. Were they counted as in flight while waiting, a call
+		// releasing the owner from inside the callable would wait for them, while they wait for it to return.
+		lock_invocation(impl->tail.invocation_lock, impl->tail.owner->options);
+		if(!impl->gate.try_enter())
+		{
+			impl->tail.invocation_lock.unlock();
+			return dropped(true);
+		}
+		
+		// The callable is not reclaimed until this call, and every other in-flight call, has returned. Declared first, so that
+		// the call releases its invocation lock and closes a once wrapper before leaving the gate, its last access to the state.
+		safe_call_scope scope(impl->gate);
+		std::lock_guard lock(impl->tail.invocation_lock, std::adopt_lock);
+		once_release release(impl.get());
+		
+		safe_tracer::trace(safe_trace_event::call_executing, impl->tail.name());
+		record_statistics(impl->tail.owner->options, [](auto& statistics) { statistics.invocations.fetch_add(1, std::memory_order_relaxed); });
+		if constexpr(std::is_void_v<R> && !std::is_void_v<Result>)
+		{
+			run(std::forward<A>(args)...);
+			return true;
+		}
+		else
+		{
+			return run(std::forward<A>(args)...);
+		}
+	}
+	
+	template <typename ...A> inline
+	R run(A&&... args) const
+	{
+		if constexpr(std::is_void_v<Callable>)
+		{
+			return impl->invoke(impl.get(), forward_argument<Args>(std::forward<A>(args))...);
+		}
+		else
+		{
+			// The callable type is known, the call does not go through any indirection and can be inlined.
+			return impl->call(std::forward<A>(args)...);
+		}
+	}
+	
+	// Helper class. Closes a once wrapper when its single call returns or throws, so that its callable is released once the call has
+	// left its gate. Does nothing under other policies.
+	//
+	// In generation mode and in cancellation groups, the wrapper's own gate is not the one its calls enter: closing it releases
+	// the callable right away, and with it maybe the last copy of the wrapper, hence the pin of once calls.
+	struct once_release
+	{
+		once_release(impl_type* impl): impl(impl) {}
+		once_release(const once_release&) = delete;
+		~once_release()
+		{
+			if constexpr(std::is_same_v<Policy, once_invocation>)
+			{
+				impl->release_once();
+			}
+		}
+		
+		impl_type* impl;
+	};
+	
+	// Returned by the calls of a once wrapper after the first one.
+	inline
+	R repeated_return_value() const
+	{
+		if constexpr(std::is_void_v<R> || std::is_void_v<DVR> || is_default_factory_v<DVR> || std::is_copy_constructible_v<DVR>)
+		{
+			return cancelled_return_value();
+		}
+		else
+		{
+			// The default value is not copy constructible, and only the first call may have returned it.
+			static_assert(is_constructible_rv_v<R>, "Once wrappers with a move-only default return value need a default constructible return type");
+			record_ignored();
+			return {};
+		}
+	}
+	
+	inline
+	void record_ignored() const
+	{
+		safe_tracer::trace(safe_trace_event::call_ignored, impl->tail.name());
+		record_statistics(impl->tail.owner->options, [](auto& statistics) { statistics.cancelled_invocations.fetch_add(1, std::memory_order_relaxed); });
+	}
+	
+	inline
+	R cancelled_return_value() const
+	{
+		record_ignored();
+		if constexpr(std::is_void_v<R>)
+		{
+			// Original callable had a void return type.
+			return;
+		}
+		else if constexpr(std::is_void_v<DVR>)
+		{
+			// No default value was provided to make_safe().
+			return {};
+		}
+		else if constexpr(is_default_factory_v<DVR>)
+		{
+			// The default value is made anew for each call.
+			return impl->tail.make_default_return_value();
+		}
+		else if constexpr(std::is_copy_constructible_v<DVR>)
+		{
+			// The provided default value is copy constructible, return by value.
+			return impl->tail.default_return_value;
+		}
+		else
+		{
+			// The provided default value is not copy constructible, return by move.
+			// Further calls to the wrapper is undefined behavior, unless it is a once wrapper.
+			return std::move(impl->tail.default_return_value);
+		}
+		
+#if __cplusplus > 202002L
+		std::unreachable();
+#endif
+	}
+	
+	typename Ownership::template handle<impl_type> impl;
+};
+
+// Helper class. A callable posted to an executor on behalf of an owner.
+//
+// Posted tasks are not wrappers: they are not registered with their owner and have no gate of their own, but enter the owner's gate,
+// which is closed on teardown in all cancellation modes. A task of a dead owner is dropped when it runs, after a single load.
+template <typename F>
+class safe_posted_task
+{
+public:
+	template <typename C>
+	safe_posted_task(C&& callable, const std::shared_ptr<safe_callbacks_impl>& owner): callable(std::forward<C>(callable)), owner(owner) {}
+	
+	inline
+	void operator()()
+	{
+		// Cheap check first, stale tasks do not even touch the gate's counter.
+		if(owner->is_cancelled.load(std::memory_order_relaxed) || !owner->gate.try_enter())
+		{
+			safe_tracer::trace(safe_trace_event::posted_task_ignored);
+			record_statistics(owner->options, [](auto& statistics) { statistics.cancelled_invocations.fetch_add(1, std::memory_order_relaxed); });
+			return;
+		}
+		
+		// The owner's teardown waits for this call to return.
+		safe_call_scope scope(owner->gate);
+		record_statistics(owner->options, [](auto& statistics) { statistics.invocations.fetch_add(1, std::memory_order_relaxed); });
+		callable();
+	}
+	
+private:
+	F callable;
+	std::shared_ptr<safe_callbacks_impl> owner;
+};
+
+template <typename E, typename T, typename = void>
+struct has_execute : std::false_type {};
+template <typename E, typename T>
+struct has_execute<E, T, std::void_t<decltype(std::declval<E&>().execute(std::declval<T>()))>> : std::true_type {};
+
+template <typename E, typename T, typename = void>
+struct has_post : std::false_type {};
+template <typename E, typename T>
+struct has_post<E, T, std::void_t<decltype(std::declval<E&>().post(std::declval<T>()))>> : std::true_type {};
+
+// Hands `task` over to `executor`. Executors are function objects taking the task, or have an execute() or post() member function taking it.
+template <typename E, typename T> inline
+void submit(E& executor, T&& task)
+{
+	if constexpr(std::is_invocable_v<E&, T>)
+	{
+		executor(std::forward<T>(task));
+	}
+	else if constexpr(has_execute<E, T>::value)
+	{
+		executor.execute(std::forward<T>(task));
+	}
+	else if constexpr(has_post<E, T>::value)
+	{
+		executor.post(std::forward<T>(task));
+	}
+	else
+	{
+		static_assert(has_post<E, T>::value, "Unsupported executor type");
+	}
+}
+
+#if SAFE_CALLBACKS_COROUTINES
+// Helper class. The state shared by all copies of a resumer: the suspended coroutine and where its result goes.
+// Whichever comes first of resuming, resuming after the owner was released, or releasing the last copy, takes the coroutine.
+template <typename T>
+class safe_resumption
+{
+public:
+	safe_resumption(std::coroutine_handle<> handle, std::optional<default_value_t<T>>* result, const std::shared_ptr<safe_callbacks_impl>& owner): handle(handle), result(result), owner(owner) {}
+	safe_resumption(const safe_resumption&) = delete;
+	safe_resumption& operator=(const safe_resumption&) = delete;
+	~safe_resumption()
+	{
+		if(auto handle = take())
+		{
+			// Never resumed, e.g. the asynchronous operation was abandoned.
+			handle.destroy();
+		}
+	}
+	
+	template <typename ...A> inline
+	void resume(A&&... value)
+	{
+		auto handle = take();
+		if(!handle)
+		{
+			return;
+		}
+		
+		if(owner->is_cancelled.load(std::memory_order_relaxed) || !owner->gate.try_enter())
+		{
+			safe_tracer::trace(safe_trace_event::coroutine_destroyed);
+			handle.destroy();
+			return;
+		}
+		
+		// The coroutine runs as a call of the owner until its next suspension, so the owner's teardown waits for it.
+		safe_call_scope scope(owner->gate);
+		result->emplace(std::forward<A>(value)...);
+		handle.resume();
+	}
+	
+	/// Takes the coroutine away from the resumer. Returns a null handle if it was taken already.
+	inline
+	std::coroutine_handle<> take() noexcept
+	{
+		return handle.exchange(nullptr, std::memory_order_acq_rel);
+	}
+	
+private:
+	std::atomic<std::coroutine_handle<>> handle;
+	std::optional<default_value_t<T>>* result;
+	std::shared_ptr<safe_callbacks_impl> owner;
+};
+
+// The function object resuming a coroutine suspended by safe_callbacks::async(). Copies share the same coroutine.
+template <typename T>
+class safe_resumer
+{
+public:
+	safe_resumer(std::shared_ptr<safe_resumption<T>> state): state(std::move(state)) {}
+	
+	inline
+	void operator()(T value) const
+	{
+		state->resume(std::move(value));
+	}
+	
+private:
+	std::shared_ptr<safe_resumption<T>> state;
+};
+
+template <>
+class safe_resumer<void>
+{
+public:
+	safe_resumer(std::shared_ptr<safe_resumption<void>> state): state(std::move(state)) {}
+	
+	inline
+	void operator()() const
+	{
+		state->resume();
+	}
+	
+private:
+	std::shared_ptr<safe_resumption<void>> state;
+};
+
+// Helper class. The awaitable returned by safe_callbacks::async().
+template <typename T, typename S>
+class safe_async_awaitable
+{
+public:
+	template <typename C>
+	safe_async_awaitable(C&& start, const std::shared_ptr<safe_callbacks_impl>& owner): start(std::forward<C>(start)), owner(owner) {}
+	
+	inline
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+	
+	inline
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		// The coroutine frame, and this awaitable with it, may be gone as soon as a resumer exists. Only locals are used from here on.
+		auto start = std::move(this->start);
+		if(owner->is_cancelled.load(std::memory_order_relaxed))
+		{
+			handle.destroy();
+			return;
+		}
+		
+		auto state = std::allocate_shared<safe_resumption<T>>(owner->allocator(), handle, &result, owner);
+		try
+		{
+			std::move(start)(safe_resumer<T>(state));
+		}
+		catch(...)
+		{
+			// The coroutine gets the exception if it has not been resumed or destroyed meanwhile.
+			if(state->take())
+			{
+				throw;
+			}
+		}
+	}
+	
+	inline
+	T await_resume()
+	{
+		if constexpr(!std::is_void_v<T>)
+		{
+			return std::move(*result);
+		}
+	}
+	
+private:
+	S start;
+	std::shared_ptr<safe_callbacks_impl> owner;
+	std::optional<default_value_t<T>> result;
+};
+#endif
+
+// Helper class. The thread a single-threaded object was created on, kept only if thread checks are enabled. Empty otherwise.
+template <bool Enabled = safe_callbacks_config::thread_checks>
+class safe_thread_affinity
+{
+public:
+	inline
+	void check_thread() const noexcept
+	{
+		assert(std::this_thread::get_id() == thread && "Single-threaded safe callbacks used from another thread");
+	}
+	
+private:
+	std::thread::id thread = std::this_thread::get_id();
+};
+
+template <>
+class safe_thread_affinity<false>
+{
+public:
+	inline
+	void check_thread() const noexcept {}
+};
+
+// Helper class. Base of objects of single-threaded owners, reference counted without atomics, and allocated from the owner's
+// memory resource by safe_local_ref::make().
+class safe_local_counted: public safe_thread_affinity<>
+{
+public:
+	safe_local_counted() = default;
+	safe_local_counted(const safe_local_counted&) = delete;
+	safe_local_counted& operator=(const safe_local_counted&) = delete;
+	
+	inline
+	void retain() noexcept
+	{
+		check_thread();
+		references++;
+	}
+	
+	inline
+	void release() noexcept
+	{
+		check_thread();
+		if(--references == 0)
+		{
+			destroy(this);
+		}
+	}
+	
+	inline
+	bool is_unique() const noexcept
+	{
+		return references == 1;
+	}
+	
+	inline
+	std::pmr::memory_resource* resource() const noexcept
+	{
+		return memory_resource;
+	}
+	
+	template <typename>
+	friend class safe_local_ref;
+	
+private:
+	uint32_t references = 1;
+	void (*destroy)(safe_local_counted*) = nullptr;
+	std::pmr::memory_resource* memory_resource = nullptr;
+};
+
+// Helper class. A reference to a safe_local_counted object, the single-threaded counterpart of std::shared_ptr.
+template <typename T>
+class safe_local_ref
+{
+public:
+	safe_local_ref() noexcept = default;
+	safe_local_ref(const safe_local_ref& other) noexcept: pointer(other.pointer)
+	{
+		retain();
+	}
+	safe_local_ref(safe_local_ref&& other) noexcept: pointer(std::exchange(other.pointer, nullptr)) {}
+	template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+	safe_local_ref(const safe_local_ref<U>& other) noexcept: pointer(other.pointer)
+	{
+		retain();
+	}
+	template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+	safe_local_ref(safe_local_ref<U>&& other) noexcept: pointer(std::exchange(other.pointer, nullptr)) {}
+	safe_local_ref& operator=(safe_local_ref other) noexcept
+	{
+		std::swap(pointer, other.pointer);
+		return *this;
+	}
+	~safe_local_ref()
+	{
+		if(pointer != nullptr)
+		{
+			pointer->release();
+		}
+	}
+	
+	template <typename ...A>
+	static safe_local_ref make(std::pmr::memory_resource* resource, A&&... args)
+	{
+		std::pmr::polymorphic_allocator<T> allocator(resource);
+		auto allocation = allocator.allocate(1);
+		
+		safe_local_ref reference;
+		try
+		{
+			reference.pointer = new (allocation) T(std::forward<A>(args)...);
+		}
+		catch(...)
+		{
+			allocator.deallocate(allocation, 1);
+			throw;
+		}
+		reference.pointer->destroy = [](safe_local_counted* counted) {
+			auto object = static_cast<T*>(counted);
+			auto resource = object->memory_resource;
+			object->~T();
+			std::pmr::polymorphic_allocator<T>(resource).deallocate(object, 1);
+		};
+		reference.pointer->memory_resource = resource;
+		return reference;
+	}
+	
+	inline
+	T* get() const noexcept
+	{
+		return pointer;
+	}
+	
+	inline
+	T* operator->() const noexcept
+	{
+		return pointer;
+	}
+	
+	template <typename>
+	friend class safe_local_ref;
+	
+private:
+	inline
+	void retain() noexcept
+	{
+		if(pointer != nullptr)
+		{
+			pointer->retain();
+		}
+	}
+	
+	T* pointer = nullptr;
+};
+
+// Helper class. The state of a single-threaded owner: a plain cancellation flag, and a plain list of its registered wrappers.
+// Outlives the owner while wrappers refer to it.
+class local_safe_callbacks_impl: public safe_local_counted
+{
+public:
+	local_safe_callbacks_impl(): entries(nullptr)
+	{
+		entries.previous = entries.next = &entries;
+	}
+	
+	inline
+	void add_cancellable(safe_cancellable* cancellable)
+	{
+		if(is_cancelled)
+		{
+			cancellable->cancel();
+			return;
+		}
+		
+		safe_tracer::trace(safe_trace_event::cancellable_added);
+		cancellable->previous = &entries;
+		cancellable->next = entries.next;
+		entries.next->previous = cancellable;
+		entries.next = cancellable;
+	}
+	
+	inline
+	void remove_cancellable(safe_cancellable* cancellable) noexcept
+	{
+		if(cancellable->next != nullptr)
+		{
+			safe_tracer::trace(safe_trace_event::cancellable_removed);
+			unlink(cancellable);
+		}
+	}
+	
+	/// Marks the owner as cancelled and cancels every registered wrapper. Wrappers may be made or released meanwhile,
+	/// e.g. by the destructors of cancelled callables.
+	inline
+	void cancel_all()
+	{
+		check_thread();
+		is_cancelled = true;
+		while(entries.next != &entries)
+		{
+			auto cancellable = entries.next;
+			unlink(cancellable);
+			cancellable->cancel();
+		}
+	}
+	
+	bool is_cancelled = false;
+	
+private:
+	inline
+	void unlink(safe_cancellable* cancellable) noexcept
+	{
+		cancellable->previous->next = cancellable->next;
+		cancellable->next->previous = cancellable->previous;
+		cancellable->previous = cancellable->next = nullptr;
+	}
+	
+	// Sentinel of the circular list of registered wrappers.
+	safe_cancellable entries;
+};
+
+// Helper class. The state shared by all copies of a wrapper of a single-threaded owner. The callable itself is stored by
+// local_safe_function_wrapper_storage, in the same allocation.
+template <typename DVR, typename R, typename ...Args>
+class local_safe_function_wrapper_impl: public safe_local_counted, public safe_cancellable, public safe_default_value<DVR>, public safe_wrapper_name<>
+{
+public:
+	local_safe_function_wrapper_impl(R (*invoke)(local_safe_function_wrapper_impl*, Args&&...),
+									 void (*reclaim)(local_safe_function_wrapper_impl*),
+									 default_value_t<DVR>&& default_return_value,
+									 const safe_local_ref<local_safe_callbacks_impl>& owner,
+									 safe_wrapper_name<>&& name):
+	safe_cancellable(&cancel), safe_default_value<DVR>(std::forward<default_value_t<DVR>>(default_return_value)), safe_wrapper_name<>(std::move(name)), invoke(invoke), reclaim(reclaim), owner(owner)
+	{}
+	
+	R (*invoke)(local_safe_function_wrapper_impl*, Args&&...);
+	void (*reclaim)(local_safe_function_wrapper_impl*);
+	safe_local_ref<local_safe_callbacks_impl> owner;
+	// Calls running, on the owner's thread: re-entrant calls, or a call releasing the owner.
+	uint32_t in_flight = 0;
+	bool is_cancelled = false;
+	
+private:
+	static void cancel(safe_cancellable* cancellable, bool)
+	{
+		auto impl = static_cast<local_safe_function_wrapper_impl*>(cancellable);
+		safe_tracer::trace(safe_trace_event::wrapper_cancelled, impl->name());
+		impl->is_cancelled = true;
+		if(impl->in_flight == 0)
+		{
+			// The callable may hold the last copy of its own wrapper: the state outlives its destruction, as in call_scope.
+			impl->retain();
+			impl->reclaim(impl);
+			impl->release();
+		}
+	}
+};
+
+// Helper class. Stores the callable of a wrapper of a single-threaded owner by value, next to its state.
+template <typename F, typename DVR, typename R, typename ...Args>
+class local_safe_function_wrapper_storage: public local_safe_function_wrapper_impl<DVR, R, Args...>
+{
+public:
+	template <typename C>
+	local_safe_function_wrapper_storage(C&& callable, default_value_t<DVR>&& default_return_value, const safe_local_ref<local_safe_callbacks_impl>& owner, safe_wrapper_name<>&& name):
+	local_safe_function_wrapper_impl<DVR, R, Args...>(&invoke, &release_callable, std::forward<default_value_t<DVR>>(default_return_value), owner, std::move(name)), callable(std::in_place, std::forward<C>(callable))
+	{}
+	~local_safe_function_wrapper_storage()
+	{
+		safe_tracer::trace(safe_trace_event::wrapper_destroyed, this->name());
+		this->owner->remove_cancellable(this);
+		callable.reset();
+	}
+	
+	template <typename ...A> inline
+	R call(A&&... args)
+	{
+		return (*callable)(std::forward<A>(args)...);
+	}
+	
+private:
+	static R invoke(local_safe_function_wrapper_impl<DVR, R, Args...>* impl, Args&&... args)
+	{
+		return static_cast<local_safe_function_wrapper_storage*>(impl)->call(std::forward<Args>(args)...);
+	}
+	
+	static void release_callable(local_safe_function_wrapper_impl<DVR, R, Args...>* impl)
+	{
+		static_cast<local_safe_function_wrapper_storage*>(impl)->callable.reset();
+	}
+	
+	std::optional<F> callable;
+};
+
+template <typename DVR, typename Signature, typename Callable = void>
+class local_safe_function_wrapper;
+
+template <typename DVR, typename Callable, typename R, typename ...Args>
+class local_safe_function_wrapper<DVR, R(Args...), Callable>
+{
+	using storage_type = local_safe_function_wrapper_storage<Callable, DVR, R, Args...>;
+	using impl_type = std::conditional_t<std::is_void_v<Callable>, local_safe_function_wrapper_impl<DVR, R, Args...>, storage_type>;
+	
+public:
+	template <typename C>
+	local_safe_function_wrapper(C&& callable, default_value_t<DVR>&& default_return_value, const safe_local_ref<local_safe_callbacks_impl>& owner, safe_wrapper_name<>&& name)
+	{
+		using concrete_storage_type = local_safe_function_wrapper_storage<std::decay_t<C>, DVR, R, Args...>;
+		static_assert(std::is_void_v<Callable> || std::is_same_v<concrete_storage_type, storage_type>, "Callable type mismatch");
+		
+		owner->check_thread();
+		impl = safe_local_ref<concrete_storage_type>::make(owner->resource(), std::forward<C>(callable), std::forward<default_value_t<DVR>>(default_return_value), owner, std::move(name));
+		owner->add_cancellable(impl.get());
+	}
+	
+	/// Converts a wrapper of a concrete callable type to a type-erased wrapper sharing the same state. Does not allocate.
+	template <typename C, typename = std::enable_if_t<std::is_void_v<Callable> && !std::is_void_v<C>>>
+	local_safe_function_wrapper(const local_safe_function_wrapper<DVR, R(Args...), C>& other): impl(other.impl) {}
+	template <typename C, typename = std::enable_if_t<std::is_void_v<Callable> && !std::is_void_v<C>>>
+	local_safe_function_wrapper(local_safe_function_wrapper<DVR, R(Args...), C>&& other): impl(std::move(other.impl)) {}
+	
+	/// Calls the wrapped callable, unless it has been cancelled, as safe_function_wrapper::operator() does.
+	template <typename ...A, typename = std::enable_if_t<is_forwardable_args_v<type_list<A...>, type_list<Args...>>>> inline
+	R operator()(A&&... args) const
+	{
+		impl->check_thread();
+		if(impl->is_cancelled)
+		{
+			return cancelled_return_value();
+		}
+		
+		// The callable is not reclaimed until this call, and every re-entrant one, has returned.
+		call_scope scope(impl.get());
+		safe_tracer::trace(safe_trace_event::call_executing, impl->name());
+		if constexpr(std::is_void_v<Callable>)
+		{
+			return impl->invoke(impl.get(), forward_argument<Args>(std::forward<A>(args))...);
+		}
+		else
+		{
+			return impl->call(std::forward<A>(args)...);
+		}
+	}
+	
+	/// Calls the wrapped callable with arguments of the parameters' own types, as safe_function_wrapper::operator() does.
+	inline
+	R operator()(Args&&... args) const
+	{
+		return operator()<Args...>(std::forward<Args>(args)...);
+	}
+	
+	/// Whether calls of the wrapper still run its callable.
+	inline
+	bool is_alive() const noexcept
+	{
+		return !impl->is_cancelled;
+	}
+	
+	template <typename, typename, typename>
+	friend class local_safe_function_wrapper;
+	
+private:
+	// Helper class. Tracks a call in flight, and keeps the wrapper's state alive for it, should the call release the wrapper.
+	struct call_scope
+	{
+		call_scope(impl_type* impl): impl(impl)
+		{
+			impl->retain();
+			impl->in_flight++;
+		}
+		call_scope(const call_scope&) = delete;
+		~call_scope()
+		{
+			if(--impl->in_flight == 0 && impl->is_cancelled)
+			{
+				// Cancelled during the call.
+				impl->reclaim(impl);
+			}
+			impl->release();
+		}
+		
+		impl_type* impl;
+	};
+	
+	inline
+	R cancelled_return_value() const
+	{
+		safe_tracer::trace(safe_trace_event::call_ignored, impl->name());
+		if constexpr(std::is_void_v<R>)
+		{
+			return;
+		}
+		else if constexpr(std::is_void_v<DVR>)
+		{
+			return {};
+		}
+		else if constexpr(is_default_factory_v<DVR>)
+		{
+			return impl->make_default_return_value();
+		}
+		else if constexpr(std::is_copy_constructible_v<DVR>)
+		{
+			return impl->default_return_value;
+		}
+		else
+		{
+			// Further calls to the wrapper is undefined behavior, as with safe_function_wrapper.
+			return std::move(impl->default_return_value);
+		}
+	}
+	
+	safe_local_ref<impl_type> impl;
+};
+}
+
+/// A cancellation group of a safe_callbacks owner, made with safe_callbacks::group().
+///
+/// Wrappers made through a group are cancelled when the group is cancelled or released, or when its owner is, whichever comes first.
+/// Cancelling a group takes constant time whatever the number of its wrappers: they share a single liveness flag and in-flight
+/// call counter, as wrappers of a `generation` mode owner do, and release their callables lazily, when their last copy is released.
+/// A group uses the owner's options and memory resource; it registers a single entry with the owner, and holds no registry
+/// of its own besides that of its subgroups, made with group().
+class safe_callbacks_group
+{
+public:
+	safe_callbacks_group(safe_callbacks_group&& other) noexcept = default;
+	safe_callbacks_group& operator=(safe_callbacks_group&& other)
+	{
+		if(this != &other)
+		{
+			cancel();
+			impl = std::move(other.impl);
+		}
+		return *this;
+	}
+	~safe_callbacks_group()
+	{
+		cancel();
+	}
+	
+	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the group's.
+	///
+	/// Behaves like safe_callbacks::make_safe(), except that the wrapper is cancelled along with the group as well.
+	/// - Parameter callable: A callable to make safe
+	template <typename Policy = serialized_invocation, typename C> inline
+	auto make_safe(C&& callable, const char*&& name = "")
+	{
+		using signature = callable_signature<C>;
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(is_constructible_rv_v<typename signature::result_type>, "Return value type is not constructible");
+		return safe_function_wrapper<void, typename signature::type, Policy, std::decay_t<C>>(std::forward<C>(callable), {}, owner(), safe_wrapper_name<>(name), &impl->gate);
+	}
+	
+	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the group's.
+	///
+	/// Behaves like safe_callbacks::make_safe() with a default return value, except that the wrapper is cancelled along with the group as well.
+	/// - Parameter default_return_value: The default value to return in case the wrapper is called after it has been cancelled
+	/// - Parameter callable: A callable to make safe
+	template <typename Policy = serialized_invocation, typename DVR, typename C> inline
+	auto make_safe(DVR&& default_return_value, C&& callable, const char*&& name = "")
+	{
+		using signature = callable_signature<C>;
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(is_compatible_rv_v<DVR, typename signature::result_type>, "Incompatible default return value type");
+		static_assert(is_returnable_rv_v<DVR>, "Unsupported default return value type");
+		return safe_function_wrapper<DVR, typename signature::type, Policy, std::decay_t<C>>(std::forward<C>(callable), std::forward<DVR>(default_return_value), owner(), safe_wrapper_name<>(name), &impl->gate);
+	}
+	
+	/// Creates a subgroup, cancelled when this group is.
+	inline
+	safe_callbacks_group group() const
+	{
+		return safe_callbacks_group(safe_callbacks_group_impl::make(impl->owner, impl));
+	}
+	
+	/// Cancels every wrapper of the group and its subgroups, waiting for their calls in flight as the owner's teardown would.
+	/// Further wrappers made through the group are cancelled from the start.
+	inline
+	void cancel()
+	{
+		if(impl != nullptr)
+		{
+			impl->cancel_group();
+		}
+	}
+	
+	friend class safe_callbacks;
+	
+private:
+	explicit safe_callbacks_group(std::shared_ptr<safe_callbacks_group_impl>&& impl): impl(std::move(impl)) {}
+	
+	// Wrappers refer to the owner through the group, which keeps it alive for them.
+	inline
+	std::shared_ptr<safe_callbacks_impl> owner() const noexcept
+	{
+		return std::shared_ptr<safe_callbacks_impl>(impl, impl->owner.get());
+	}
+	
+	std::shared_ptr<safe_callbacks_group_impl> impl;
+};
+
+class safe_callbacks
+{
+public:
+	/// Invocation policy letting simultaneous calls of a wrapper run the callable in parallel.
+	using concurrent = concurrent_invocation;
+	/// Invocation policy running the callable of a wrapper on one thread at a time. Re-entrant calls from the same thread are allowed.
+	/// This is the default policy.
+	using serialized = serialized_invocation;
+	
+	/// Invocation policy running the callable of a wrapper once at most: later calls are dropped. The callable and its captures
+	/// are released, and the wrapper unregistered from its owner, as soon as the first call returns. See make_safe_once().
+	using once = once_invocation;
+	
+	/// Type-erased safe function object wrapper type.
+	///
+	/// Wrappers returned by make_safe() are typed after the callable they wrap, so that calling them can be inlined.
+	/// Any of them with a matching signature, default return value type and policy converts to this type without allocating.
+	template <typename Signature, typename DVR = void, typename Policy = serialized>
+	using function = safe_function_wrapper<DVR, Signature, Policy>;
+	
+	/// Type-erased unique safe function object wrapper type.
+	///
+	/// Wrappers returned by make_safe_unique() are move-only and own their state exclusively: unlike make_safe() wrappers,
+	/// moving and releasing them does not touch any reference count. Any of them with a matching signature, default return
+	/// value type and policy converts to this type on move, without allocating.
+	template <typename Signature, typename DVR = void, typename Policy = serialized>
+	using unique_function = safe_function_wrapper<DVR, Signature, Policy, void, unique_ownership>;
+	
+	/// Default return value known at compile time: `make_safe(safe_callbacks::default_constant<-1>(), callable)`.
+	/// Wrappers made with it carry no default value, and name it as their default return value type.
+	template <auto Value>
+	using default_constant = safe_default_factory<safe_constant_factory<Value>>;
+	
+	/// Default return value made by an `F` factory for each cancelled call, instead of being stored by each wrapper.
+	/// Stateless factories take no room in wrappers, and move-only values can be returned by any number of cancelled calls.
+	template <typename F>
+	using default_factory = safe_default_factory<F>;
+	
+	/// Makes a default return value out of `factory`: `make_safe(safe_callbacks::default_from([] { return std::make_unique<T>(); }), callable)`.
+	template <typename F> static inline
+	default_factory<std::decay_t<F>> default_from(F&& factory)
+	{
+		return default_factory<std::decay_t<F>>(std::forward<F>(factory));
+	}
+	
+	/// Cancellation modes.
+	///
+	/// With `per_wrapper` (the default), each wrapper is registered with the owner and cancelled individually on teardown,
+	/// which releases its callable right away. Teardown cost grows with the number of live wrappers.
+	///
+	/// With `generation`, wrappers share a single liveness flag and in-flight call counter with their owner.
+	/// Teardown flips that flag and waits for in-flight calls, in constant time regardless of the number of wrappers.
+	/// Cancelled callables are then released lazily, when the last copy of their wrapper is released.
+	using cancellation_mode = safe_cancellation_mode;
+	
+	/// Reclaimers receive cancelled callables, so that their destructors, which may be expensive, do not run on the cancelling thread.
+	///
+	/// Custom reclaimers derive from `safe_callbacks::reclaimer`, and call `reclaim()` on the tasks they receive, which allocate
+	/// from their owner's memory resource. `safe_callbacks::background_reclaimer` reclaims them on a thread of its own, and
+	/// `background_reclaimer::shared()` is a process-wide instance of it. Use `flush()` for deterministic shutdown.
+	using reclaimer = safe_reclaimer;
+	using reclamation_task = safe_reclamation_task;
+	using background_reclaimer = safe_background_reclaimer;
+	
+	/// Owner options: the cancellation mode, and an optional reclaimer for cancelled callables.
+	///
+	/// With a `resource`, the owner and its wrappers do not allocate from the global heap. Wrappers may outlive their owner,
+	/// so an arena resource (e.g. `std::pmr::monotonic_buffer_resource`) may only be released once all of them have been released.
+	/// Callables wrapped in a `std::function` still allocate their own storage from the global heap.
+	///
+	/// With `wait_for_calls` unset, the owner's teardown takes bounded time: it cancels every wrapper, so that no further call
+	/// starts, but does not wait for calls already running, even on other threads. This gives up the guarantee that callables never
+	/// run after their owner is gone; state they share with the owner should be kept alive by them (e.g. a captured `shared_ptr`),
+	/// or released from `on_drained`, which is called once the last of these calls has returned.
+	using options = safe_callbacks_options;
+	
+	/// Activity counters, if statistics are enabled (`SAFE_CALLBACKS_STATISTICS`): live wrappers, calls run and dropped,
+	/// time serialized calls waited for each other, and teardown time. Pass one to an owner through its options to collect
+	/// its counters; several owners may share one. Without `SAFE_CALLBACKS_STATISTICS`, nothing is counted and nothing is paid.
+	using statistics = safe_callbacks_statistics;
+	
+	/// Build configuration: whether wrappers keep their names (`SAFE_CALLBACKS_NAMES`, DEBUG builds by default), and whether tracing
+	/// events are reported (`SAFE_CALLBACKS_TRACING`). Disabled features cost nothing: nameless wrappers carry no name at all.
+	using config = safe_callbacks_config;
+	
+	/// Tracing events, reported to the hook installed with set_trace_hook() if tracing is enabled.
+	using trace_event = safe_trace_event;
+	using trace_hook = safe_trace_hook;
+	
+	/// Installs `hook` as the receiver of tracing events of the whole program, replacing the current one. Null disables reporting.
+	/// Until a hook is installed, translation units built with `SAFE_CALLBACKS_DEBUG_PRINTS` print their events.
+	static inline
+	void set_trace_hook(trace_hook hook) noexcept
+	{
+		safe_tracer::set_hook(hook);
+	}
+	
+	safe_callbacks(): impl(safe_callbacks_impl::make({})) {}
+	explicit safe_callbacks(cancellation_mode mode): impl(safe_callbacks_impl::make(options_for(mode, nullptr))) {}
+	explicit safe_callbacks(std::pmr::memory_resource* resource): impl(safe_callbacks_impl::make(options_for(cancellation_mode::per_wrapper, resource))) {}
+	explicit safe_callbacks(const options& options): impl(safe_callbacks_impl::make(options)) {}
+	// These are explicitly allowed and do nothing on purpose.
+	// Wrapped callables are tied to a specific object, and should not be copied or moved.
+	// A copy takes the cancellation mode, memory resource, reclaimer and statistics of `other`, but neither `wait_for_calls`
+	// nor `on_drained`: those are about the teardown of the object holding `other`, which `on_drained` typically releases.
+	safe_callbacks(const safe_callbacks& other): impl(safe_callbacks_impl::make(copied_options(other.impl->options))) {}
+	safe_callbacks& operator=(const safe_callbacks&) noexcept { return *this; }
+	~safe_callbacks()
+	{
+		safe_tracer::trace(safe_trace_event::owner_destroyed);
+		impl->cancel_all();
+	}
+		
+	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's.
+	///
+	/// If the owning object is released, the wrapper function is cancelled and automatically replaces the wrapped `callable` with a no-op.
+	///
+	/// In case of cancellation, if the return type of `callable` is not void, the wrapper function constructs and returns a default return value.
+	///
+	/// The optional `Policy` template argument selects whether simultaneous calls of the wrapper may run `callable` in parallel
+	/// (`safe_callbacks::concurrent`) or not (`safe_callbacks::serialized`, the default).
+	///
+	/// The returned wrapper stores `callable` by value and is typed after it. Convert it to `safe_callbacks::function` to erase that type.
+	/// `callable` is stored inline, in the same allocation as the wrapper's state, whatever its size.
+	/// - Parameter callable: A callable to make safe
+	template <typename Policy = serialized, typename C> inline
+	auto make_safe(C&& callable, const char*&& name = "")
+	{
+		using signature = callable_signature<C>;
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(is_constructible_rv_v<typename signature::result_type>, "Return value type is not constructible");
+		return safe_function_wrapper<void, typename signature::type, Policy, std::decay_t<C>>(std::forward<C>(callable), {}, impl, safe_wrapper_name<>(name));
+	}
+	
+	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's.
+	///
+	/// If the owning object is released, the wrapper function is cancelled and automatically replaces the wrapped `callable` with a no-op.
+	///
+	/// In case of cancellation, in cases where the return type of `callable` is not void, the wrapper function constructs and returns a default return value.
+	///
+	/// The optional `Policy` template argument selects whether simultaneous calls of the wrapper may run `callable` in parallel
+	/// (`safe_callbacks::concurrent`) or not (`safe_callbacks::serialized`, the default).
+	///
+	/// The `std::function` is stored inline, but keeps its own storage for its target. Pass the callable itself to avoid that allocation.
+	/// - Parameter callable: A `std::function` to make safe
+	template <typename Policy = serialized, typename R, typename ...Args> inline
+	safe_function_wrapper<void, R(Args...), Policy> make_safe(std::function<R(Args...)>&& callable, const char*&& name = "")
+	{
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(is_constructible_rv_v<R>, "Return value type is not constructible");
+		return safe_function_wrapper<void, R(Args...), Policy>(std::forward<std::function<R(Args...)>>(callable), {}, impl, safe_wrapper_name<>(name));
+	}
+
+	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's.
+	///
+	/// If the owning object is released, the wrapper function is cancelled and automatically replaces the wrapped `callable` with a no-op.
+	///
+	/// In case of cancellation, the wrapper function returns the provided default return value. If the default return value is copy constructible,
+	/// it is returned by value. Otherwise, it is returned by move. In case of return by move, it is undefined behavior of the wrapper function
+	/// is called more than once. Pass a `default_constant` or `default_from()` factory instead, to have each cancelled call return a fresh value.
+	///
+	/// The optional `Policy` template argument selects whether simultaneous calls of the wrapper may run `callable` in parallel
+	/// (`safe_callbacks::concurrent`) or not (`safe_callbacks::serialized`, the default).
+	///
+	/// The returned wrapper stores `callable` by value and is typed after it. Convert it to `safe_callbacks::function` to erase that type.
+	/// `callable` is stored inline, in the same allocation as the wrapper's state, whatever its size.
+	/// - Parameter default_return_value: The default value to return in case the wrapper is called after it has been cancelled
+	/// - Parameter callable: A callable to make safe
+	template <typename Policy = serialized, typename DVR, typename C> inline
+	auto make_safe(DVR&& default_return_value, C&& callable, const char*&& name = "")
+	{
+		using signature = callable_signature<C>;
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(is_compatible_rv_v<DVR, typename signature::result_type>, "Incompatible default return value type");
+		static_assert(is_returnable_rv_v<DVR>, "Unsupported default return value type");
+		return safe_function_wrapper<DVR, typename signature::type, Policy, std::decay_t<C>>(std::forward<C>(callable), std::forward<DVR>(default_return_value), impl, safe_wrapper_name<>(name));
+	}
+	
+	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's.
+	///
+	/// If the owning object is released, the wrapper function is cancelled and automatically replaces the wrapped `callable` with a no-op.
+	///
+	/// In case of cancellation, the wrapper function returns the provided default return value. If the default return value is copy constructible,
+	/// it is returned by value. Otherwise, it is returned by move. In case of return by move, it is undefined behavior if the wrapper function
+	/// is called more than once. Pass a `default_constant` or `default_from()` factory instead, to have each cancelled call return a fresh value.
+	///
+	/// The optional `Policy` template argument selects whether simultaneous calls of the wrapper may run `callable` in parallel
+	/// (`safe_callbacks::concurrent`) or not (`safe_callbacks::serialized`, the default).
+	///
+	/// The `std::function` is stored inline, but keeps its own storage for its target. Pass the callable itself to avoid that allocation.
+	/// - Parameter default_return_value: The default value to return in case the wrapper is called after it has been cancelled
+	/// - Parameter callable: A `std::function` to make safe
+	template <typename Policy = serialized, typename DVR, typename R, typename ...Args> inline
+	safe_function_wrapper<DVR, R(Args...), Policy> make_safe(DVR&& default_return_value, std::function<R(Args...)>&& callable, const char*&& name = "")
+	{
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(is_compatible_rv_v<DVR, R>, "Incompatible default return value type");
+		static_assert(is_returnable_rv_v<DVR>, "Unsupported default return value type");
+		return safe_function_wrapper<DVR, R(Args...), Policy>(std::forward<std::function<R(Args...)>>(callable), std::forward<DVR>(default_return_value), impl, safe_wrapper_name<>(name));
+	}
+	
+	/// Cancels every wrapper, group, posted task and suspended coroutine of the owner, as releasing the owner would,
+	/// and re-arms it for new ones.
+	///
+	/// The owner's state, registry included, is reused as is if nothing refers to it anymore, which is the case once every
+	/// wrapper of the owner has been released. Otherwise, it is left to the cancelled wrappers, and the owner starts over with
+	/// fresh state, allocated from its memory resource.
+	///
+	/// May be called from any thread, from inside one of the owner's own callbacks included: calls in flight on other threads
+	/// are waited for (unless `wait_for_calls` is unset), while those on the calling thread keep running once this returns.
+	/// The owner object itself is not thread-safe, though: this must not be called concurrently with its other members,
+	/// make_safe(), cancel_async() and its destructor included, nor with another cancel_all(). Its wrappers, groups and
+	/// their copies may be used and released on any thread meanwhile.
+	inline
+	void cancel_all()
+	{
+		impl->cancel_all();
+		rearm();
+	}
+	
+	/// Cancels every wrapper, group, posted task and suspended coroutine of the owner as cancel_all() does, but without waiting
+	/// for calls in flight, even on other threads: `on_drained` is called once the last of them has returned, on its thread,
+	/// or before this function returns if there are none. The owner is re-armed for new wrappers right away.
+	///
+	/// No further call starts once this function returns, but calls in flight may keep running afterwards, as with the
+	/// `wait_for_calls` option unset. This lets the teardowns of many owners overlap, instead of blocking a thread for each.
+	inline
+	void cancel_async(std::function<void()> on_drained)
+	{
+		impl->cancel_all(on_drained ? std::move(on_drained) : [] {});
+		rearm();
+	}
+	
+	/// Cancels the owner as cancel_async() does, and returns a future which becomes ready once calls in flight have drained.
+	inline
+	std::future<void> cancel_async()
+	{
+		auto drained = std::make_shared<std::promise<void>>();
+		auto future = drained->get_future();
+		cancel_async([drained] { drained->set_value(); });
+		return future;
+	}
+	
+	/// Creates a cancellation group, whose wrappers can be cancelled together, on their own and in constant time.
+	/// The group is cancelled when released, and when the owner is. See `safe_callbacks_group`.
+	inline
+	safe_callbacks_group group() const
+	{
+		return safe_callbacks_group(safe_callbacks_group_impl::make(impl, nullptr));
+	}
+	
+	/// Creates safe function object wrappers around each of `callables` at once, and ties their lifetimes to the owner's.
+	///
+	/// Returns a tuple of the wrappers make_safe() would return, one per callable, in order. Their states are allocated together
+	/// and registered with the owner in one pass, which takes each registry lock once instead of once per wrapper. In exchange,
+	/// they are only released together: releasing a wrapper early does not release its callable until the last wrapper of the
+	/// batch is released, or the owner is.
+	/// - Parameter callables: The callables to make safe
+	template <typename Policy = serialized, typename ...C> inline
+	auto make_safe_all(C&&... callables)
+	{
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(std::conjunction_v<is_constructible_rv<typename callable_signature<C>::result_type>...>, "Return value type is not constructible");
+		return make_batch<Policy>(std::index_sequence_for<C...>{}, std::forward<C>(callables)...);
+	}
+	
+	/// Creates a one-shot safe function object wrapper around `callable` and ties its lifetime to the owner's.
+	///
+	/// Behaves like make_safe(), but only the first call of the wrapper runs `callable`. As soon as it returns, `callable` is released
+	/// and the wrapper is unregistered from its owner, so that completion handlers left in queues do not weigh on the owner's teardown.
+	/// Later calls, like calls after cancellation, return a default constructed value.
+	/// - Parameter callable: A callable to make safe
+	template <typename C> inline
+	auto make_safe_once(C&& callable, const char*&& name = "")
+	{
+		return make_safe<once>(std::forward<C>(callable), std::move(name));
+	}
+	
+	/// Creates a one-shot safe function object wrapper around `callable` and ties its lifetime to the owner's.
+	///
+	/// Behaves like make_safe_once(), but calls made after cancellation return `default_return_value`. If it is not copy constructible,
+	/// it is returned by move to the first call only, and later calls return a default constructed value.
+	/// - Parameter default_return_value: The default value to return in case the wrapper is called after it has been cancelled
+	/// - Parameter callable: A callable to make safe
+	template <typename DVR, typename C> inline
+	auto make_safe_once(DVR&& default_return_value, C&& callable, const char*&& name = "")
+	{
+		return make_safe<once>(std::forward<DVR>(default_return_value), std::forward<C>(callable), std::move(name));
+	}
+	
+	/// Creates a move-only safe function object wrapper around `callable` and ties its lifetime to the owner's.
+	///
+	/// Behaves like make_safe(), but the returned wrapper cannot be copied. It owns its state alone, so that no reference count
+	/// is maintained when it is moved or released. Convert it to `safe_callbacks::unique_function` to erase the callable type.
+	/// Nor do its calls keep it alive: its callable must not own it, e.g. through a `shared_ptr` to an object holding it.
+	/// - Parameter callable: A callable to make safe
+	template <typename Policy = serialized, typename C> inline
+	auto make_safe_unique(C&& callable, const char*&& name = "")
+	{
+		using signature = callable_signature<C>;
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(is_constructible_rv_v<typename signature::result_type>, "Return value type is not constructible");
+		return safe_function_wrapper<void, typename signature::type, Policy, std::decay_t<C>, unique_ownership>(std::forward<C>(callable), {}, impl, safe_wrapper_name<>(name));
+	}
+	
+	/// Creates a move-only safe function object wrapper around `callable` and ties its lifetime to the owner's.
+	///
+	/// Behaves like make_safe() with a default return value, but the returned wrapper cannot be copied, and owns its state alone.
+	/// - Parameter default_return_value: The default value to return in case the wrapper is called after it has been cancelled
+	/// - Parameter callable: A callable to make safe
+	template <typename Policy = serialized, typename DVR, typename C> inline
+	auto make_safe_unique(DVR&& default_return_value, C&& callable, const char*&& name = "")
+	{
+		using signature = callable_signature<C>;
+		static_assert(is_invocation_policy_v<Policy>, "Unsupported invocation policy");
+		static_assert(is_compatible_rv_v<DVR, typename signature::result_type>, "Incompatible default return value type");
+		static_assert(is_returnable_rv_v<DVR>, "Unsupported default return value type");
+		return safe_function_wrapper<DVR, typename signature::type, Policy, std::decay_t<C>, unique_ownership>(std::forward<C>(callable), std::forward<DVR>(default_return_value), impl, safe_wrapper_name<>(name));
+	}
+	
+	/// Posts `callable` to `executor`, tied to the owner's lifetime.
+	///
+	/// Unlike make_safe(), no wrapper is created or registered: the posted task checks the owner's liveness when it runs, and is dropped
+	/// after a single load if the owner has been released by then. The owner's teardown waits for posted tasks already running,
+	/// as it does for wrappers. Tasks of a released owner still occupy their executor's queue until they are dequeued, and release
+	/// `callable` then.
+	///
+	/// `executor` is a function object taking the task (e.g. a lambda forwarding it to `asio::post()`), or has an `execute()`
+	/// or `post()` member function taking it. The task is copyable if `callable` is.
+	/// - Parameter executor: The executor to run `callable` on
+	/// - Parameter callable: A callable taking no arguments
+	template <typename E, typename C> inline
+	void post(E&& executor, C&& callable)
+	{
+		static_assert(std::is_invocable_v<std::decay_t<C>&>, "Posted callables must be invocable without arguments");
+		submit(executor, safe_posted_task<std::decay_t<C>>(std::forward<C>(callable), impl));
+	}
+	
+#if SAFE_CALLBACKS_COROUTINES
+	/// Suspends the calling coroutine until a resumer tied to the owner's lifetime is called, e.g. `auto n = co_await cb.async<size_t>(start);`.
+	///
+	/// `start` is called with the resumer, a copyable function object taking a `T` (nothing if `T` is void), to hand over to an asynchronous
+	/// operation. Calling the resumer resumes the coroutine with the value passed as the result of `co_await`. Further calls do nothing.
+	///
+	/// If the owner has been released by the time the resumer is called, the coroutine is not resumed and its frame is destroyed instead,
+	/// as it is if the last copy of the resumer is released without having been called. Until its next suspension, a resumed coroutine
+	/// runs as a call of the owner, whose teardown waits for it: the owner is alive after `co_await` without any further check.
+	/// As frames may be destroyed at these suspension points, this is meant for coroutines nothing else awaits, such as detached tasks.
+	/// - Parameter start: A callable taking the resumer
+	template <typename T = void, typename S> inline
+	auto async(S&& start)
+	{
+		static_assert(std::is_invocable_v<std::decay_t<S>, safe_resumer<T>>, "The start callable must take a resumer");
+		return safe_async_awaitable<T, std::decay_t<S>>(std::forward<S>(start), impl);
+	}
+#endif
+	
+	template <typename>
+	friend class safe_signal;
+	
+private:
+	static inline
+	options options_for(cancellation_mode mode, std::pmr::memory_resource* resource)
+	{
+		options result;
+		result.mode = mode;
+		result.resource = resource;
+		return result;
+	}
+	
+	static inline
+	options copied_options(const options& other)
+	{
+		options result = options_for(other.mode, other.resource);
+		result.reclaimer = other.reclaimer;
+		result.statistics = other.statistics;
+		return result;
+	}
 	
 	inline
-	void add_cancellable(std::shared_ptr<std::function<void(void)>> cancellable)
+	void rearm()
 	{
-		if(is_cancelled)
+		if(impl.use_count() == 1)
 		{
-			(*cancellable)();
-			return;
+			// No wrapper, task or group can reach the state anymore, and every gate has drained. use_count() is a relaxed load:
+			// the fence makes what the threads which released the other references did with the state visible before reusing it.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			impl->rearm();
 		}
-		
-#if SAFE_CALLBACKS_DEBUG_PRINTS
-		std::println("Adding cancellable");
-#endif
-		std::lock_guard lock(this->lock);
-		
-		if(is_cancelled)
+		else
 		{
-			(*cancellable)();
-			return;
+			impl = safe_callbacks_impl::make(impl->options);
 		}
-		
-		//Adds a std::weak_ptr of the cancellable.
-		cancellables.insert_or_assign(cancellable.get(), cancellable);
 	}
 	
-	inline
-	void remove_cancellable(std::function<void(void)>* cancellablePtr)
+	template <typename Policy, std::size_t ...I, typename ...C> inline
+	auto make_batch(std::index_sequence<I...>, C&&... callables)
 	{
-		if(is_cancelled)
+		using batch_type = safe_wrapper_batch<std::index_sequence<I...>, typename safe_batch_entry<Policy, C>::storage_type...>;
+		auto batch = std::allocate_shared<batch_type>(impl->allocator(), impl, std::forward<C>(callables)...);
+		if(impl->options.mode == cancellation_mode::per_wrapper)
 		{
-			return;
+			impl->add_cancellables(std::array<safe_cancellable*, sizeof...(C)>{&batch->template get<I>().tail...});
 		}
 		
-#if SAFE_CALLBACKS_DEBUG_PRINTS
-		std::println("Removing cancellable");
-#endif
-		std::lock_guard lock(this->lock);
-		cancellables.erase(cancellablePtr);
+		// Each wrapper shares ownership of the whole batch, and points at its own state in it.
+		return std::tuple<typename safe_batch_entry<Policy, C>::wrapper_type...>(
+			typename safe_batch_entry<Policy, C>::wrapper_type(std::shared_ptr<typename safe_batch_entry<Policy, C>::storage_type>(batch, &batch->template get<I>()))...
+		);
 	}
 	
-	std::atomic<bool> is_cancelled = false;
-	std::mutex lock;
-	std::unordered_map<void*, std::weak_ptr<std::function<void(void)>>> cancellables;
+	std::shared_ptr<safe_callbacks_impl> impl;
 };
 
-template <typename DVR, typename F>
-class safe_function_wrapper;
+template <typename Signature>
+class safe_signal;
 
-template<typename DVR, typename R, typename ...Args>
-class safe_function_wrapper_impl: public std::enable_shared_from_this<safe_function_wrapper_impl<DVR, R, Args...>>
+/// Multicast signal, calling each of its subscribers for as long as the owner the subscriber is tied to is alive.
+///
+/// Subscribers are stored by value in blocks of contiguous slots, which never move once allocated, and emissions call them
+/// in one pass in slot order, checking each slot's own liveness flag. Emissions take no lock and no reference count: they
+/// register with each block they go through, in the block's current epoch, so that slots freed meanwhile are only reused
+/// once no emission that could still be reading them remains. Each call enters the owner's gate, so the owner's teardown waits
+/// for it as it does for wrappers, but no per-subscriber lock is taken. Subscribers of released owners are skipped after a flag
+/// check, and their slots freed by the emission that finds them, or else by the next connection or emission.
+/// The first freed slots are reused first, so that subscribers gather in the first blocks.
+///
+/// Subscribers may connect, disconnect and emit from inside a subscriber. Subscribers connected during an emission may or may
+/// not be called by it, and are called by the next ones. Subscribers disconnected during an emission are not called by it
+/// anymore. Results of subscribers are discarded.
+///
+/// The signal's lock is only held to connect, disconnect and free slots, never while subscribers run: emissions from several
+/// threads call subscribers concurrently, and a subscriber disconnected while another thread's emission calls it may still be
+/// running when disconnect() returns. Releasing its owner waits for it. Slots of a block freed while an emission calls one of
+/// its subscribers are only reused once that call has returned.
+template <typename R, typename ...Args>
+class safe_signal<R(Args...)>
 {
+	static_assert(std::conjunction_v<std::negation<std::is_rvalue_reference<Args>>...>, "Signal arguments are passed to each subscriber, and cannot be rvalue references");
+	
 public:
-	safe_function_wrapper_impl(std::function<R(Args...)>&& callable,
-							   default_value_t<DVR>&& default_return_value,
-							   std::weak_ptr<safe_callbacks_impl> owner,
-							   const char* &&name):
-	std::enable_shared_from_this<safe_function_wrapper_impl>(), lock(), callable(std::make_unique<std::function<R(Args...)>>(std::move(callable))), owner(owner), default_return_value(std::forward<default_value_t<DVR>>(default_return_value))
-#if DEBUG
-	, name(std::move(name))
-#endif
-	{}
-	safe_function_wrapper_impl() = delete;
-	safe_function_wrapper_impl(const safe_function_wrapper_impl&) = delete;
-	safe_function_wrapper_impl& operator=(const safe_function_wrapper_impl&) = delete;
-	~safe_function_wrapper_impl()
+	safe_signal() = default;
+	safe_signal(const safe_signal&) = delete;
+	safe_signal& operator=(const safe_signal&) = delete;
+	
+	/// Connects `callable`, tied to the lifetime of `owner`.
+	/// - Parameter owner: The owner of the subscriber
+	/// - Parameter callable: A callable to call on each emission
+	template <typename C> inline
+	void connect(safe_callbacks& owner, C&& callable)
 	{
-#if SAFE_CALLBACKS_DEBUG_PRINTS
-		std::println("Destructing safe_function_wrapper_impl of {0}", SAFE_CALLBACKS_GET_NAME(this));
-#endif
-		callable.reset();
-		remove_cancel();
-		cancel.reset();
-		owner.reset();
-#if DEBUG
-		name.clear();
-#endif
+		static_assert(std::is_invocable_v<std::decay_t<C>&, Args...>, "Subscribers must be invocable with the signal's arguments");
+		std::function<R(Args...)> function(std::forward<C>(callable));
+		std::vector<released_slot> released;
+		
+		std::lock_guard lock(this->lock);
+		tidy(released);
+		auto& slot = free_slot();
+		slot.owner = owner.impl;
+		slot.callable = std::move(function);
+		slot.state.store(slot_state::live, std::memory_order_release);
+		subscribers++;
 	}
 	
-	default_value_t<DVR> default_return_value;
-
+	/// Disconnects every subscriber tied to `owner`.
+	/// - Parameter owner: The owner of the subscribers to disconnect
 	inline
-	void make_cancel()
+	void disconnect(const safe_callbacks& owner)
 	{
-		cancel = std::make_shared<std::function<void(void)>>(std::bind(&safe_function_wrapper<DVR, R(Args...)>::cancel, this->weak_from_this()));
+		std::vector<released_slot> released;
+		
+		std::lock_guard lock(this->lock);
+		for(size_t index = 0; index < blocks.size() * block_size; index++)
+		{
+			// Slots emissions found dead first are on the dead list already.
+			auto& slot = slot_at(index);
+			auto state = slot_state::live;
+			if(slot.owner == owner.impl && slot.state.compare_exchange_strong(state, slot_state::dead, std::memory_order_relaxed))
+			{
+				blocks[index / block_size]->live.fetch_sub(1, std::memory_order_relaxed);
+				retire(index);
+			}
+		}
+		tidy(released);
 	}
 	
+	/// Calls every subscriber whose owner is still alive with `args`.
 	inline
-	void remove_cancel()
+	void emit(Args... args)
 	{
-		if (auto _owner = owner.lock())
+		for(auto block = first.load(std::memory_order_acquire); block != nullptr; block = block->next.load(std::memory_order_acquire))
+		{
+			// Blocks without live subscribers are skipped at once.
+			if(block->live.load(std::memory_order_relaxed) == 0)
+			{
+				continue;
+			}
+			
+			pinned_block pinned(*block);
+			
+			// Runs of subscribers of the same owner in the block are called within a single call of that owner, which the block's
+			// slots keep alive: it is left before the block is.
+			std::optional<safe_call_scope> call;
+			const safe_callbacks_impl* entered = nullptr;
+			
+			for(size_t i = 0, used = block->used.load(std::memory_order_acquire); i < used; i++)
+			{
+				auto& slot = block->slots[i];
+				if(slot.state.load(std::memory_order_acquire) != slot_state::live)
+				{
+					continue;
+				}
+				
+				auto owner = slot.owner.get();
+				if(owner != entered)
+				{
+					call.reset();
+					entered = nullptr;
+					if(!owner->is_cancelled.load(std::memory_order_relaxed) && owner->gate.try_enter())
+					{
+						call.emplace(owner->gate);
+						entered = owner;
+					}
+				}
+				
+				// The owner might have been released by a previous subscriber of the run.
+				if(entered == nullptr || owner->gate.is_closed())
+				{
+					auto state = slot_state::live;
+					if(slot.state.compare_exchange_strong(state, slot_state::dead, std::memory_order_relaxed))
+					{
+						block->live.fetch_sub(1, std::memory_order_relaxed);
+						push_dead(slot, block->first_index + i);
+					}
+					continue;
+				}
+				
+				slot.callable(args...);
+			}
+		}
+		
+		// Slots are freed by whichever emission finds them dead first, without waiting for another thread's connection.
+		if(dead_slots.load(std::memory_order_relaxed) != no_slot || has_retired_slots.load(std::memory_order_relaxed))
 		{
-			_owner->remove_cancellable(cancel.get());
+			std::vector<released_slot> released;
+			std::unique_lock lock(this->lock, std::try_to_lock);
+			if(lock.owns_lock())
+			{
+				tidy(released);
+			}
 		}
 	}
 	
-	std::recursive_mutex lock;
-	std::unique_ptr<std::function<R(Args...)>> callable;
-	std::weak_ptr<safe_callbacks_impl> owner;
-	std::shared_ptr<std::function<void(void)>> cancel;
-#if DEBUG
-	std::string name;
-#endif
-};
-
-template<typename DVR, typename R, typename ...Args>
-class safe_function_wrapper<DVR, R(Args...)>
-{
-public:
-	safe_function_wrapper(std::function<R(Args...)>&& callable, default_value_t<DVR>&& default_return_value, std::weak_ptr<safe_callbacks_impl> owner, const char* &&name)
+	inline
+	void operator()(Args... args)
 	{
-		auto locked = owner.lock();
-		impl = std::make_shared<safe_function_wrapper_impl<DVR, R, Args...>>(std::forward<std::function<R(Args...)>>(callable), std::forward<default_value_t<DVR>>(default_return_value), owner, std::forward<const char*>(name));
-		impl->make_cancel();
-		locked->add_cancellable(impl->cancel);
+		emit(std::forward<Args>(args)...);
 	}
 	
+	/// The number of subscribers, including those of released owners whose slots have not been freed yet.
 	inline
-	R operator()(Args&&... args) const
+	size_t size() const
 	{
-		std::function<R(Args...)>* target;
-		
-		std::lock_guard lock(impl->lock);
-		target = impl->callable.get();
-		
-		if(target == nullptr)
+		std::lock_guard lock(this->lock);
+		return subscribers;
+	}
+	
+private:
+	enum class slot_state: uint8_t
+	{
+		empty,
+		live,
+		// Disconnected, or found tied to a released owner: skipped by emissions until the slot is freed.
+		dead
+	};
+	
+	struct slot
+	{
+		std::atomic<slot_state> state = slot_state::empty;
+		// Only written under the lock, while the slot is empty and no emission reads it.
+		std::shared_ptr<safe_callbacks_impl> owner;
+		std::function<R(Args...)> callable;
+		// The next slot of the dead list, written by the emission which found the slot dead.
+		size_t next_dead;
+	};
+	
+	static constexpr size_t block_size = 32;
+	static constexpr size_t no_slot = SIZE_MAX;
+	
+	struct block
+	{
+		// Registers an emission in the current epoch, and returns the reader count it registered in. The epoch is checked
+		// again once registered: if it has advanced meanwhile, advance() may not have seen the registration, which is then
+		// made again in the new epoch.
+		inline
+		std::atomic<uint32_t>& enter() noexcept
 		{
-#if SAFE_CALLBACKS_DEBUG_PRINTS
-			std::println("(): ignoring");
-#endif
-			if constexpr(std::is_void_v<R>)
+			for(;;)
 			{
-				// Original callable had a void return type.
-				return;
-			}
-			else if constexpr(std::is_void_v<DVR>)
-			{
-				// No default value was provided to make_safe().
-				return {};
-			}
-			else if constexpr(std::is_copy_constructible_v<DVR>)
-			{
-				// The provided default value is copy constructible, return by value.
-				return impl->default_return_value;
+				auto current = epoch.load();
+				auto& registered = readers[current & 1];
+				registered.fetch_add(1);
+				if(epoch.load() == current)
+				{
+					return registered;
+				}
+				registered.fetch_sub(1, std::memory_order_relaxed);
 			}
-			else
+		}
+		
+		// Called under the lock. Advances the epoch if no emission registered in the previous one remains: emissions
+		// registered in an epoch have all left the block once the epoch has advanced twice.
+		inline
+		void advance() noexcept
+		{
+			auto current = epoch.load(std::memory_order_relaxed);
+			if(readers[(current + 1) & 1].load() == 0)
 			{
-				// The provided default value is not copy constructible, return by move.
-				// Further calls to the wrapper is undefined behavior.
-				return std::move(impl->default_return_value);
+				epoch.store(current + 1);
 			}
-			
-#if __cplusplus > 202002L
-			std::unreachable();
-#endif
 		}
 		
-#if SAFE_CALLBACKS_DEBUG_PRINTS
-		std::println("(): executing");
-#endif
-		return (*target)(std::forward<Args>(args)...);
+		explicit block(size_t first_index) noexcept: first_index(first_index) {}
+		
+		slot slots[block_size];
+		const size_t first_index;
+		// Slots handed out so far, which emissions go through. Only grows.
+		std::atomic<size_t> used = 0;
+		// Live subscribers: a slot made live counts before its state is published, and stops counting once made dead.
+		std::atomic<size_t> live = 0;
+		// Slots freed and not handed out again since. Only accessed under the lock.
+		size_t freed = 0;
+		std::atomic<block*> next = nullptr;
+		// Emissions register in the reader count of the parity of the epoch they found the block in.
+		std::atomic<uint64_t> epoch = 0;
+		std::atomic<uint32_t> readers[2] = {};
+	};
+	
+	// Registers an emission with a block while it goes through the block's slots.
+	class pinned_block
+	{
+	public:
+		explicit pinned_block(block& pinned) noexcept: readers(pinned.enter()) {}
+		~pinned_block()
+		{
+			readers.fetch_sub(1, std::memory_order_release);
+		}
+		pinned_block(const pinned_block&) = delete;
+		pinned_block& operator=(const pinned_block&) = delete;
+		
+	private:
+		std::atomic<uint32_t>& readers;
+	};
+	
+	// The contents of a freed slot, released once the lock is not held anymore.
+	struct released_slot
+	{
+		std::shared_ptr<safe_callbacks_impl> owner;
+		std::function<R(Args...)> callable;
+	};
+	
+	// A slot no longer called, by its index, and the epoch of its block it was retired in.
+	struct retired_slot
+	{
+		size_t index;
+		uint64_t epoch;
+	};
+	
+	inline
+	slot& slot_at(size_t index) const noexcept
+	{
+		return blocks[index / block_size]->slots[index % block_size];
+	}
+	
+	// Pushes a slot an emission found dead, of index `index`, on the dead list, which tidy() takes whole.
+	inline
+	void push_dead(slot& dead, size_t index) noexcept
+	{
+		auto head = dead_slots.load(std::memory_order_relaxed);
+		do
+		{
+			dead.next_dead = head;
+		}
+		while(!dead_slots.compare_exchange_weak(head, index, std::memory_order_release, std::memory_order_relaxed));
 	}
 	
-	friend class safe_function_wrapper_impl<DVR, R, Args...>;
+	// Called under the lock. Stops counting a dead slot, which is freed once no emission can be reading it anymore.
+	inline
+	void retire(size_t index)
+	{
+		slot_at(index).state.store(slot_state::empty, std::memory_order_relaxed);
+		retired.push_back({index, blocks[index / block_size]->epoch.load(std::memory_order_relaxed)});
+		subscribers--;
+	}
 	
-protected:
-	static void cancel(std::weak_ptr<safe_function_wrapper_impl<DVR, R, Args...>> weak_impl)
+	// Called under the lock. Retires the slots emissions found dead, and frees the slots retired long enough ago.
+	inline
+	void tidy(std::vector<released_slot>& released)
 	{
-		if (auto impl = weak_impl.lock())
+		for(auto index = dead_slots.exchange(no_slot, std::memory_order_acquire); index != no_slot; )
 		{
-#if SAFE_CALLBACKS_DEBUG_PRINTS
-			std::println("Cancelling function wrapper of {0}", SAFE_CALLBACKS_GET_NAME(impl));
-#endif
-			std::lock_guard lock(impl->lock);
-			impl->callable.reset();
+			auto next = slot_at(index).next_dead;
+			retire(index);
+			index = next;
 		}
+		reclaim(released);
 	}
-private:
-	std::shared_ptr<safe_function_wrapper_impl<DVR, R, Args...>> impl;
-};
-}
-
-class safe_callbacks
-{
-public:
-	safe_callbacks(): impl(std::make_shared<safe_callbacks_impl>()) {}
-	// These are explicitly allowed and do nothing on purpose.
-	// Wrapped callables are tied to a specific object, and should not be copied or moved.
-	safe_callbacks(const safe_callbacks&): impl(std::make_shared<safe_callbacks_impl>()) {}
-	safe_callbacks& operator=(const safe_callbacks&) noexcept { return *this; }
-	~safe_callbacks()
+	
+	// Called under the lock. Frees the retired slots no emission can be reading anymore, moving their contents to `released`.
+	inline
+	void reclaim(std::vector<released_slot>& released)
 	{
-#if SAFE_CALLBACKS_DEBUG_PRINTS
-		std::println("Destructing safe_callbacks");
-#endif
-		impl->is_cancelled = true;
-		
-		std::lock_guard lock(impl->lock);
-		for (auto& [key, weak_cancellable] : impl->cancellables)
+		if(retired.empty())
 		{
-			if (auto cancellable = weak_cancellable.lock())
+			return;
+		}
+		
+		auto reclaimable = std::stable_partition(retired.begin(), retired.end(), [this](const retired_slot& entry) {
+			auto& owning = *blocks[entry.index / block_size];
+			for(int i = 0; i < 2 && owning.epoch.load(std::memory_order_relaxed) < entry.epoch + 2; i++)
 			{
-				(*cancellable)();
+				owning.advance();
 			}
+			return owning.epoch.load(std::memory_order_relaxed) < entry.epoch + 2;
+		});
+		for(auto entry = reclaimable; entry != retired.end(); ++entry)
+		{
+			auto& slot = slot_at(entry->index);
+			released.push_back({std::move(slot.owner), std::move(slot.callable)});
+			slot.owner = nullptr;
+			slot.callable = nullptr;
+			free_slots.push_back(entry->index);
+			std::push_heap(free_slots.begin(), free_slots.end(), std::greater<>());
+			blocks[entry->index / block_size]->freed++;
+		}
+		retired.erase(reclaimable, retired.end());
+		has_retired_slots.store(!retired.empty(), std::memory_order_relaxed);
+		
+		// Emissions stop going through the last blocks once all of their slots are free. Those emissions which are already
+		// going through them find no live slot there.
+		while(linked > 0 && blocks[linked - 1]->freed == blocks[linked - 1]->used.load(std::memory_order_relaxed))
+		{
+			linked--;
+			(linked == 0 ? first : blocks[linked - 1]->next).store(nullptr, std::memory_order_release);
 		}
-		impl->cancellables.clear();
 	}
+	
+	// Called under the lock. An empty slot no emission reads: the first of the freed ones, or a new one.
+	inline
+	slot& free_slot()
+	{
+		size_t index;
+		if(!free_slots.empty())
+		{
+			std::pop_heap(free_slots.begin(), free_slots.end(), std::greater<>());
+			index = free_slots.back();
+			free_slots.pop_back();
+			blocks[index / block_size]->freed--;
+		}
+		else
+		{
+			// Blocks are only added once all of them are in use, and linked then.
+			if(blocks.empty() || blocks.back()->used.load(std::memory_order_relaxed) == block_size)
+			{
+				blocks.emplace_back(std::make_unique<block>(blocks.size() * block_size));
+			}
+			
+			// Emissions only read the slot once it is live.
+			auto& last = *blocks.back();
+			index = (blocks.size() - 1) * block_size + last.used.load(std::memory_order_relaxed);
+			last.used.store(index % block_size + 1, std::memory_order_release);
+		}
 		
-	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's.
-	///
-	/// If the owning object is released, the wrapper function is cancelled and automatically replaces the wrapped `callable` with a no-op.
-	///
-	/// In case of cancellation, if the return type of `callable` is not void, the wrapper function constructs and returns a default return value.
+		for(; linked <= index / block_size; linked++)
+		{
+			(linked == 0 ? first : blocks[linked - 1]->next).store(blocks[linked].get(), std::memory_order_release);
+		}
+		blocks[index / block_size]->live.fetch_add(1, std::memory_order_relaxed);
+		return slot_at(index);
+	}
+	
+	// Not held while subscribers run, so that they may call back into the signal, and other threads may connect while they wait for a subscriber's owner.
+	mutable std::mutex lock;
+	std::atomic<block*> first = nullptr;
+	// Owned here, and never released before the signal: the first `linked` ones are linked through `first` for emissions,
+	// up to the last one with a slot in use.
+	std::vector<std::unique_ptr<block>> blocks;
+	size_t linked = 0;
+	// A min-heap of the indices of freed slots.
+	std::vector<size_t> free_slots;
+	std::vector<retired_slot> retired;
+	size_t subscribers = 0;
+	// The first slot of the list of those emissions found dead, linked through their `next_dead`.
+	std::atomic<size_t> dead_slots = no_slot;
+	std::atomic<bool> has_retired_slots = false;
+};
+
+/// Single-threaded owner of safe function object wrappers, for objects living on a single thread (e.g. an event loop's).
+///
+/// Behaves like safe_callbacks in its default mode, without any synchronization: the owner's state and its wrappers' are
+/// reference counted and flagged without atomics, and calls take no lock. In exchange, the owner, its wrappers and their copies
+/// must all be used and released on the thread that created the owner; this is asserted with `SAFE_CALLBACKS_THREAD_CHECKS`,
+/// which defaults to DEBUG builds. Cancelled callables are released right away, on that thread, and activity is not counted.
+class local_safe_callbacks
+{
+public:
+	/// Type-erased safe function object wrapper type of single-threaded owners.
+	template <typename Signature, typename DVR = void>
+	using function = local_safe_function_wrapper<DVR, Signature>;
+	
+	/// Default return values known at compile time, or made by a factory, as with safe_callbacks.
+	template <auto Value>
+	using default_constant = safe_callbacks::default_constant<Value>;
+	template <typename F>
+	using default_factory = safe_callbacks::default_factory<F>;
+	
+	local_safe_callbacks(): local_safe_callbacks(nullptr) {}
+	/// With a `resource`, the owner and its wrappers do not allocate from the global heap, as with safe_callbacks.
+	explicit local_safe_callbacks(std::pmr::memory_resource* resource): impl(make_impl(resource)) {}
+	// These are explicitly allowed and do nothing on purpose, as with safe_callbacks.
+	local_safe_callbacks(const local_safe_callbacks& other): impl(make_impl(other.impl->resource())) {}
+	local_safe_callbacks& operator=(const local_safe_callbacks&) noexcept { return *this; }
+	~local_safe_callbacks()
+	{
+		safe_tracer::trace(safe_trace_event::owner_destroyed);
+		impl->cancel_all();
+	}
+	
+	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's, as safe_callbacks::make_safe() does.
 	/// - Parameter callable: A callable to make safe
 	template <typename C> inline
 	auto make_safe(C&& callable, const char*&& name = "")
 	{
-		return make_safe(std::function{std::forward<C>(callable)}, std::forward<const char*>(name));
+		using signature = callable_signature<C>;
+		static_assert(is_constructible_rv_v<typename signature::result_type>, "Return value type is not constructible");
+		return local_safe_function_wrapper<void, typename signature::type, std::decay_t<C>>(std::forward<C>(callable), {}, impl, safe_wrapper_name<>(name));
 	}
 	
-	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's.
-	///
-	/// If the owning object is released, the wrapper function is cancelled and automatically replaces the wrapped `callable` with a no-op.
-	///
-	/// In case of cancellation, in cases where the return type of `callable` is not void, the wrapper function constructs and returns a default return value.
-	/// - Parameter callable: A `std::function` to make safe
-	template <typename R, typename ...Args> inline
-	safe_function_wrapper<void, R(Args...)> make_safe(std::function<R(Args...)>&& callable, const char*&& name = "")
-	{
-		static_assert(is_constructible_rv_v<R>, "Return value type is not constructible");
-		return safe_function_wrapper<void, R(Args...)>(std::forward<std::function<R(Args...)>>(callable), {}, impl, std::forward<const char*>(name));
-	}
-
-	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's.
-	///
-	/// If the owning object is released, the wrapper function is cancelled and automatically replaces the wrapped `callable` with a no-op.
-	///
-	/// In case of cancellation, the wrapper function returns the provided default return value. If the default return value is copy constructible,
-	/// it is returned by value. Otherwise, it is returned by move. In case of return by move, it is undefined behavior of the wrapper function
-	/// is called more than once.
+	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's, as safe_callbacks::make_safe() does.
 	/// - Parameter default_return_value: The default value to return in case the wrapper is called after it has been cancelled
 	/// - Parameter callable: A callable to make safe
 	template <typename DVR, typename C> inline
 	auto make_safe(DVR&& default_return_value, C&& callable, const char*&& name = "")
 	{
-		return make_safe(std::forward<DVR>(default_return_value), std::function{std::forward<C>(callable)}, std::forward<const char*>(name));
+		using signature = callable_signature<C>;
+		static_assert(is_compatible_rv_v<DVR, typename signature::result_type>, "Incompatible default return value type");
+		static_assert(is_returnable_rv_v<DVR>, "Unsupported default return value type");
+		return local_safe_function_wrapper<DVR, typename signature::type, std::decay_t<C>>(std::forward<C>(callable), std::forward<DVR>(default_return_value), impl, safe_wrapper_name<>(name));
 	}
 	
-	/// Creates a safe function object wrapper around `callable` and ties its lifetime to the owner's.
-	///
-	/// If the owning object is released, the wrapper function is cancelled and automatically replaces the wrapped `callable` with a no-op.
-	///
-	/// In case of cancellation, the wrapper function returns the provided default return value. If the default return value is copy constructible,
-	/// it is returned by value. Otherwise, it is returned by move. In case of return by move, it is undefined behavior if the wrapper function
-	/// is called more than once.
-	/// - Parameter default_return_value: The default value to return in case the wrapper is called after it has been cancelled
-	/// - Parameter callable: A `std::function` to make safe
-	template <typename DVR, typename R, typename ...Args> inline
-	safe_function_wrapper<DVR, R(Args...)> make_safe(DVR&& default_return_value, std::function<R(Args...)>&& callable, const char*&& name = "")
+	/// Cancels every wrapper of the owner, as releasing it would, and re-arms it for new ones, as safe_callbacks::cancel_all() does.
+	inline
+	void cancel_all()
 	{
-		static_assert(is_compatible_rv_v<DVR, R>, "Incompatible default return value type");
-		static_assert(is_returnable_rv_v<DVR>, "Unsupported default return value type");
-		return safe_function_wrapper<DVR, R(Args...)>(std::forward<std::function<R(Args...)>>(callable), std::forward<DVR>(default_return_value), impl, std::forward<const char*>(name));
+		impl->cancel_all();
+		if(impl->is_unique())
+		{
+			impl->is_cancelled = false;
+		}
+		else
+		{
+			impl = make_impl(impl->resource());
+		}
 	}
 	
 private:
-	std::shared_ptr<safe_callbacks_impl> impl;
+	static inline
+	safe_local_ref<local_safe_callbacks_impl> make_impl(std::pmr::memory_resource* resource)
+	{
+		return safe_local_ref<local_safe_callbacks_impl>::make(resource != nullptr ? resource : std::pmr::get_default_resource());
+	}
+	
+	safe_local_ref<local_safe_callbacks_impl> impl;
 };
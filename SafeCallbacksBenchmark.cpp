@@ -0,0 +1,412 @@
+//
+//  SafeCallbacksBenchmark.cpp
+//  SafeCallbacks
+//
+//  Microbenchmarks of safe_callbacks, built against Google Benchmark:
+//  c++ -std=c++17 -O2 -DNDEBUG SafeCallbacksBenchmark.cpp -lbenchmark -lpthread
+//
+
+#include "SafeCallbacks.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// A callable capturing `Size` bytes of state.
+template <std::size_t Size>
+struct sized_callable
+{
+	std::array<char, Size> state{};
+
+	int operator()(int value) const
+	{
+		return value + state[0];
+	}
+};
+
+/*
+ Construction
+ */
+
+template <std::size_t Size>
+static void BM_StdFunctionConstruct(benchmark::State& state)
+{
+	for(auto _ : state)
+	{
+		std::function<int(int)> function = sized_callable<Size>{};
+		benchmark::DoNotOptimize(function);
+	}
+}
+BENCHMARK_TEMPLATE(BM_StdFunctionConstruct, 8);
+BENCHMARK_TEMPLATE(BM_StdFunctionConstruct, 64);
+BENCHMARK_TEMPLATE(BM_StdFunctionConstruct, 512);
+
+template <std::size_t Size>
+static void BM_MakeSafe(benchmark::State& state)
+{
+	safe_callbacks cb;
+	for(auto _ : state)
+	{
+		auto wrapper = cb.make_safe(sized_callable<Size>{});
+		benchmark::DoNotOptimize(wrapper);
+	}
+}
+BENCHMARK_TEMPLATE(BM_MakeSafe, 8);
+BENCHMARK_TEMPLATE(BM_MakeSafe, 64);
+BENCHMARK_TEMPLATE(BM_MakeSafe, 512);
+
+template <std::size_t Size>
+static void BM_MakeSafeGeneration(benchmark::State& state)
+{
+	safe_callbacks cb(safe_callbacks::cancellation_mode::generation);
+	for(auto _ : state)
+	{
+		auto wrapper = cb.make_safe(sized_callable<Size>{});
+		benchmark::DoNotOptimize(wrapper);
+	}
+}
+BENCHMARK_TEMPLATE(BM_MakeSafeGeneration, 8);
+BENCHMARK_TEMPLATE(BM_MakeSafeGeneration, 512);
+
+template <std::size_t Size>
+static void BM_MakeSafeUnique(benchmark::State& state)
+{
+	safe_callbacks cb;
+	for(auto _ : state)
+	{
+		auto wrapper = cb.make_safe_unique(sized_callable<Size>{});
+		benchmark::DoNotOptimize(wrapper);
+	}
+}
+BENCHMARK_TEMPLATE(BM_MakeSafeUnique, 8);
+BENCHMARK_TEMPLATE(BM_MakeSafeUnique, 512);
+
+// Startup of an object with many callbacks: eight wrappers created one by one, or as a batch.
+static void BM_MakeSafeEach(benchmark::State& state)
+{
+	safe_callbacks cb;
+	for(auto _ : state)
+	{
+		auto wrappers = std::make_tuple(cb.make_safe(sized_callable<8>{}), cb.make_safe(sized_callable<8>{}), cb.make_safe(sized_callable<8>{}), cb.make_safe(sized_callable<8>{}),
+										cb.make_safe(sized_callable<8>{}), cb.make_safe(sized_callable<8>{}), cb.make_safe(sized_callable<8>{}), cb.make_safe(sized_callable<8>{}));
+		benchmark::DoNotOptimize(wrappers);
+	}
+}
+BENCHMARK(BM_MakeSafeEach);
+
+static void BM_MakeSafeAll(benchmark::State& state)
+{
+	safe_callbacks cb;
+	for(auto _ : state)
+	{
+		auto wrappers = cb.make_safe_all(sized_callable<8>{}, sized_callable<8>{}, sized_callable<8>{}, sized_callable<8>{},
+										 sized_callable<8>{}, sized_callable<8>{}, sized_callable<8>{}, sized_callable<8>{});
+		benchmark::DoNotOptimize(wrappers);
+	}
+}
+BENCHMARK(BM_MakeSafeAll);
+
+// Handing a wrapper over, as callers storing callbacks do: a reference count update for shared wrappers, none for unique ones.
+static void BM_MoveShared(benchmark::State& state)
+{
+	safe_callbacks cb;
+	std::vector<safe_callbacks::function<int(int)>> stored;
+	auto wrapper = cb.make_safe(sized_callable<8>{});
+	for(auto _ : state)
+	{
+		stored.push_back(wrapper);
+		stored.pop_back();
+	}
+}
+BENCHMARK(BM_MoveShared);
+
+static void BM_MoveUnique(benchmark::State& state)
+{
+	safe_callbacks cb;
+	std::vector<safe_callbacks::unique_function<int(int)>> stored;
+	stored.push_back(cb.make_safe_unique(sized_callable<8>{}));
+	for(auto _ : state)
+	{
+		auto wrapper = std::move(stored.back());
+		stored.pop_back();
+		stored.push_back(std::move(wrapper));
+	}
+}
+BENCHMARK(BM_MoveUnique);
+
+/*
+ Invocation, uncontended with one thread and contended on a single shared wrapper with more.
+ */
+
+static constexpr int thread_counts[] = {1, 2, 4, 8};
+
+static void BM_CallStdFunction(benchmark::State& state)
+{
+	static const std::function<int(int)> function = sized_callable<8>{};
+	int value = 0;
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = function(value));
+	}
+}
+
+static safe_callbacks& shared_owner()
+{
+	static safe_callbacks cb;
+	return cb;
+}
+
+static void BM_CallConcrete(benchmark::State& state)
+{
+	static const auto wrapper = shared_owner().make_safe<safe_callbacks::concurrent>(sized_callable<8>{});
+	int value = 0;
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = wrapper(value));
+	}
+}
+
+static void BM_CallErased(benchmark::State& state)
+{
+	static const safe_callbacks::function<int(int), void, safe_callbacks::concurrent> wrapper = shared_owner().make_safe<safe_callbacks::concurrent>(sized_callable<8>{});
+	int value = 0;
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = wrapper(value));
+	}
+}
+
+static void BM_CallSerialized(benchmark::State& state)
+{
+	static const auto wrapper = shared_owner().make_safe<safe_callbacks::serialized>(sized_callable<8>{});
+	int value = 0;
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = wrapper(value));
+	}
+}
+
+static void BM_CallGeneration(benchmark::State& state)
+{
+	static safe_callbacks cb(safe_callbacks::cancellation_mode::generation);
+	static const auto wrapper = cb.make_safe<safe_callbacks::concurrent>(sized_callable<8>{});
+	int value = 0;
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = wrapper(value));
+	}
+}
+
+// Single-threaded owners, called from their own thread only.
+static void BM_CallLocal(benchmark::State& state)
+{
+	local_safe_callbacks cb;
+	auto wrapper = cb.make_safe(sized_callable<8>{});
+	int value = 0;
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = wrapper(value));
+	}
+}
+BENCHMARK(BM_CallLocal);
+
+static void BM_MakeSafeLocal(benchmark::State& state)
+{
+	local_safe_callbacks cb;
+	for(auto _ : state)
+	{
+		auto wrapper = cb.make_safe(sized_callable<8>{});
+		benchmark::DoNotOptimize(wrapper);
+	}
+}
+BENCHMARK(BM_MakeSafeLocal);
+
+static void BM_CallCancelled(benchmark::State& state)
+{
+	static const auto wrapper = [] {
+		safe_callbacks cb;
+		return cb.make_safe<safe_callbacks::concurrent>(sized_callable<8>{});
+	}();
+	int value = 0;
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = wrapper(value));
+	}
+}
+
+static void apply_thread_counts(benchmark::internal::Benchmark* benchmark)
+{
+	for(auto count : thread_counts)
+	{
+		benchmark->Threads(count);
+	}
+	benchmark->UseRealTime();
+}
+
+BENCHMARK(BM_CallStdFunction)->Apply(apply_thread_counts);
+BENCHMARK(BM_CallConcrete)->Apply(apply_thread_counts);
+BENCHMARK(BM_CallErased)->Apply(apply_thread_counts);
+BENCHMARK(BM_CallSerialized)->Apply(apply_thread_counts);
+BENCHMARK(BM_CallGeneration)->Apply(apply_thread_counts);
+BENCHMARK(BM_CallCancelled)->Apply(apply_thread_counts);
+
+/*
+ Registry churn: creating and releasing wrappers of an owner which already has `state.range(0)` live wrappers,
+ from one or more threads at once.
+ */
+
+static void BM_RegistryChurn(benchmark::State& state)
+{
+	static safe_callbacks cb;
+	static std::vector<safe_callbacks::function<int(int)>> live;
+	if(state.thread_index() == 0)
+	{
+		for(int64_t i = 0; i < state.range(0); i++)
+		{
+			live.push_back(cb.make_safe(sized_callable<8>{}));
+		}
+	}
+
+	for(auto _ : state)
+	{
+		auto wrapper = cb.make_safe(sized_callable<8>{});
+		benchmark::DoNotOptimize(wrapper);
+	}
+
+	if(state.thread_index() == 0)
+	{
+		live.clear();
+	}
+}
+BENCHMARK(BM_RegistryChurn)->Arg(0)->Arg(1 << 10)->Arg(1 << 16)->ThreadRange(1, 8)->UseRealTime();
+
+/*
+ Teardown of an owner with `state.range(0)` live wrappers. Only the teardown itself is timed; as setting up the wrappers
+ takes far longer than tearing them down in generation mode, the number of iterations is fixed.
+ */
+
+static constexpr int teardown_iterations = 16;
+
+template <typename F>
+static void time_iteration(benchmark::State& state, F&& timed)
+{
+	auto start = std::chrono::steady_clock::now();
+	timed();
+	state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+static void teardown(benchmark::State& state, safe_callbacks::cancellation_mode mode)
+{
+	for(auto _ : state)
+	{
+		auto cb = std::make_unique<safe_callbacks>(mode);
+		std::vector<safe_callbacks::function<int(int)>> live;
+		live.reserve(state.range(0));
+		for(int64_t i = 0; i < state.range(0); i++)
+		{
+			live.push_back(cb->make_safe(sized_callable<8>{}));
+		}
+
+		time_iteration(state, [&] { cb.reset(); });
+	}
+	state.SetComplexityN(state.range(0));
+}
+
+static void BM_TeardownPerWrapper(benchmark::State& state)
+{
+	teardown(state, safe_callbacks::cancellation_mode::per_wrapper);
+}
+BENCHMARK(BM_TeardownPerWrapper)->RangeMultiplier(32)->Range(1, 1 << 20)->Iterations(teardown_iterations)->UseManualTime()->Unit(benchmark::kMicrosecond)->Complexity();
+
+static void BM_TeardownGeneration(benchmark::State& state)
+{
+	teardown(state, safe_callbacks::cancellation_mode::generation);
+}
+BENCHMARK(BM_TeardownGeneration)->RangeMultiplier(32)->Range(1, 1 << 20)->Iterations(teardown_iterations)->UseManualTime()->Unit(benchmark::kMicrosecond)->Complexity();
+
+// Baseline: releasing the same number of plain std::function objects.
+static void BM_TeardownStdFunction(benchmark::State& state)
+{
+	for(auto _ : state)
+	{
+		std::vector<std::function<int(int)>> live(state.range(0), sized_callable<8>{});
+
+		time_iteration(state, [&] { live.clear(); });
+	}
+	state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_TeardownStdFunction)->RangeMultiplier(32)->Range(1, 1 << 20)->Iterations(teardown_iterations)->UseManualTime()->Unit(benchmark::kMicrosecond)->Complexity();
+
+/*
+ One request's worth of callbacks, cancelled as the request completes: a fresh owner per request, or a group of a long-lived owner.
+ */
+
+static void BM_OwnerPerRequest(benchmark::State& state)
+{
+	for(auto _ : state)
+	{
+		safe_callbacks cb;
+		auto wrappers = std::make_tuple(cb.make_safe(sized_callable<8>{}), cb.make_safe(sized_callable<8>{}), cb.make_safe(sized_callable<8>{}));
+		benchmark::DoNotOptimize(wrappers);
+	}
+}
+BENCHMARK(BM_OwnerPerRequest);
+
+static void BM_GroupPerRequest(benchmark::State& state)
+{
+	safe_callbacks cb;
+	for(auto _ : state)
+	{
+		auto group = cb.group();
+		auto wrappers = std::make_tuple(group.make_safe(sized_callable<8>{}), group.make_safe(sized_callable<8>{}), group.make_safe(sized_callable<8>{}));
+		benchmark::DoNotOptimize(wrappers);
+	}
+}
+BENCHMARK(BM_GroupPerRequest);
+
+/*
+ Fan-out of one emission to `state.range(0)` subscribers: a signal against a vector of wrappers.
+ */
+
+static void BM_EmitSignal(benchmark::State& state)
+{
+	safe_callbacks cb;
+	safe_signal<void(int)> signal;
+	int sum = 0;
+	for(int64_t i = 0; i < state.range(0); i++)
+	{
+		signal.connect(cb, [&sum](int value) { sum += value; });
+	}
+	for(auto _ : state)
+	{
+		signal.emit(1);
+	}
+	benchmark::DoNotOptimize(sum);
+}
+BENCHMARK(BM_EmitSignal)->Arg(16)->Arg(256);
+
+static void BM_EmitWrapperVector(benchmark::State& state)
+{
+	safe_callbacks cb;
+	std::vector<safe_callbacks::function<void(int)>> subscribers;
+	int sum = 0;
+	for(int64_t i = 0; i < state.range(0); i++)
+	{
+		subscribers.push_back(cb.make_safe([&sum](int value) { sum += value; }));
+	}
+	for(auto _ : state)
+	{
+		for(auto& subscriber : subscribers)
+		{
+			subscriber(1);
+		}
+	}
+	benchmark::DoNotOptimize(sum);
+}
+BENCHMARK(BM_EmitWrapperVector)->Arg(16)->Arg(256);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,1401 @@
+//
+//  SafeCallbacksStress.cpp
+//  SafeCallbacks
+//
+//  Stress test of concurrent wrapper creation, calls and owner teardown, including teardown from inside callbacks.
+//  Reports throughput and call latency per configuration, and fails if a callback ever ran after its owner's teardown, or if a
+//  signal's subscriber was not called or not removed in time.
+//  Configurations cover shared, once and unique wrappers, batches made by make_safe_all(), groups, callables referring to their own
+//  wrapper or to an object holding it, callables released on a background reclaimer, posted tasks, signals (connected to while
+//  emissions overlap included), coroutines (when built as C++20), asynchronous teardown, teardown from another translation unit,
+//  and single-threaded owners.
+//  Deterministic checks come first, of what the configurations do not exercise: default return values made for each cancelled call,
+//  move-only default return values of once and single-threaded wrappers, liveness queries, memory resources, tracing hooks and
+//  padded wrappers, the last two only doing something in builds enabling them.
+//  Built with SAFE_CALLBACKS_STATISTICS=1, it also fails if the statistics of the owners disagree with the calls the callables
+//  counted, or if a wrapper is still alive once a run is over.
+//  Build it as is, or with -fsanitize=thread or -fsanitize=address to catch races and use after free:
+//  c++ -std=c++17 -O2 SafeCallbacksStress.cpp SafeCallbacksStressElsewhere.cpp -lpthread
+//  ./a.out [seconds per configuration] [creator threads] [invoker threads]
+//
+
+#include "SafeCallbacks.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using stress_clock = std::chrono::steady_clock;
+
+static constexpr std::size_t owner_slots = 16;
+static constexpr std::size_t wrapper_slots = 256;
+// One in this many owner updates by creators tears the owner down, one in this many calls tears it down from inside.
+static constexpr uint32_t teardown_odds = 8;
+static constexpr uint32_t inside_teardown_odds = 512;
+// One in this many owner updates by creators replaces the owner's group, or disconnects the owner from the signal.
+// One in this many calls of a grouped wrapper replaces its group from inside.
+static constexpr uint32_t regroup_odds = 16;
+static constexpr uint32_t inside_regroup_odds = 64;
+// Posted tasks and suspended coroutines waiting for invokers. The oldest are dropped beyond this.
+static constexpr std::size_t queue_capacity = 4096;
+// One in this many calls has its latency sampled.
+static constexpr uint32_t latency_sampling = 16;
+
+// Defined in SafeCallbacksStressElsewhere.cpp: cancels `cb` from another translation unit than the calls it waits for.
+void stress_cancel_elsewhere(safe_callbacks& cb);
+
+// How owners are torn down.
+enum class stress_teardown
+{
+	// Released, which waits for their calls in flight.
+	release,
+	// Cancelled with cancel_async(), and released once their calls in flight have drained.
+	cancel_async,
+	// Cancelled with the overload of cancel_async() returning a future, and released once it is ready.
+	cancel_future,
+	// Cancelled with cancel_all() from another translation unit, then released.
+	elsewhere,
+	// Cancelled with cancel_all(), which does not wait for calls in flight (`wait_for_calls` unset), and released once they have
+	// drained, from `on_drained`.
+	detached,
+};
+
+// Counters of a run, shared by all threads.
+struct stress_counters
+{
+	std::atomic<uint64_t> creations = 0;
+	std::atomic<uint64_t> calls = 0;
+	std::atomic<uint64_t> runs = 0;
+	std::atomic<uint64_t> teardowns = 0;
+	std::atomic<uint64_t> inside_teardowns = 0;
+	std::atomic<uint64_t> violations = 0;
+};
+
+// Outlives its owner, so that callbacks may tell whether its teardown has returned.
+struct stress_record
+{
+	std::atomic<bool> torn_down = false;
+};
+
+// An object with safe callbacks. Callbacks touch its members, so that a call running after its teardown is a use after free.
+struct stress_owner
+{
+	stress_owner(safe_callbacks::cancellation_mode mode, bool grouped, stress_teardown teardown, safe_callbacks::reclaimer* reclaimer, safe_callbacks::statistics* statistics):
+		cb(options_for(mode, teardown, reclaimer, statistics))
+	{
+		if(grouped)
+		{
+			group.emplace(cb.group());
+		}
+	}
+
+	std::atomic<uint64_t> runs = 0;
+	std::shared_ptr<stress_record> record = std::make_shared<stress_record>();
+	// Guarded by the slot lock: how many times `group` was replaced, and whether a call of its wrappers is replacing it.
+	uint64_t group_generation = 0;
+	bool regrouping_inside = false;
+	// With detached teardown, keeps the owner alive from its teardown until its calls in flight have drained.
+	std::shared_ptr<stress_owner> draining;
+	// Declared last, so that wrappers are cancelled before the members above are released.
+	safe_callbacks cb;
+	std::optional<safe_callbacks_group> group;
+
+private:
+	safe_callbacks::options options_for(safe_callbacks::cancellation_mode mode, stress_teardown teardown, safe_callbacks::reclaimer* reclaimer, safe_callbacks::statistics* statistics)
+	{
+		safe_callbacks::options options;
+		options.mode = mode;
+		options.reclaimer = reclaimer;
+		options.statistics = statistics;
+		if(teardown == stress_teardown::detached)
+		{
+			options.wait_for_calls = false;
+			// Also called when the owner is released, once its teardown is over, with nothing to wait for.
+			options.on_drained = [this] {
+				record->torn_down.store(true, std::memory_order_release);
+				draining.reset();
+			};
+		}
+		return options;
+	}
+};
+
+struct owner_slot
+{
+	std::mutex lock;
+	std::shared_ptr<stress_owner> owner;
+	// Owners torn down with cancel_future from inside their calls, which cannot wait for the future. Creators wait for it.
+	std::vector<std::pair<std::future<void>, std::shared_ptr<stress_owner>>> draining;
+};
+
+static uint32_t random_below(std::minstd_rand& random, uint32_t bound)
+{
+	return std::uniform_int_distribution<uint32_t>(0, bound - 1)(random);
+}
+
+// Tears down the owner of `slot` if it is still `expected` (or whichever it is, if null). Returns whether it did.
+// A call does not tear its owner down while another one is replacing their group: each would wait for the other.
+static bool tear_down(owner_slot& slot, const stress_owner* expected, stress_teardown teardown, stress_counters& counters)
+{
+	std::shared_ptr<stress_owner> owner;
+	{
+		std::lock_guard lock(slot.lock);
+		if(slot.owner == nullptr || (expected != nullptr && (slot.owner.get() != expected || expected->regrouping_inside)))
+		{
+			return false;
+		}
+		owner = std::move(slot.owner);
+	}
+
+	auto record = owner->record;
+	switch(teardown)
+	{
+		case stress_teardown::release:
+			owner.reset();
+			record->torn_down.store(true, std::memory_order_release);
+			break;
+		case stress_teardown::cancel_async:
+			// No callback may run once the calls in flight have drained. The owner is released by whichever of this thread
+			// and the drained handler is last.
+			owner->cb.cancel_async([owner, record] {
+				record->torn_down.store(true, std::memory_order_release);
+			});
+			owner.reset();
+			break;
+		case stress_teardown::cancel_future:
+		{
+			// The future is made ready by the last call in flight, on its thread, while this one may still be running.
+			auto drained = owner->cb.cancel_async();
+			if(expected != nullptr)
+			{
+				std::lock_guard lock(slot.lock);
+				slot.draining.emplace_back(std::move(drained), std::move(owner));
+				break;
+			}
+			drained.wait();
+			record->torn_down.store(true, std::memory_order_release);
+			owner.reset();
+			break;
+		}
+		case stress_teardown::elsewhere:
+			stress_cancel_elsewhere(owner->cb);
+			record->torn_down.store(true, std::memory_order_release);
+			owner.reset();
+			break;
+		case stress_teardown::detached:
+			// The owner is released by whichever of this thread and `on_drained` is last. The calls draining may release the
+			// objects holding their wrappers meanwhile.
+			owner->draining = owner;
+			owner->cb.cancel_all();
+			owner.reset();
+			break;
+	}
+	counters.teardowns.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+// Releases the owners of `slot` torn down with cancel_future from inside their calls, once those calls have drained.
+static void reap(owner_slot& slot)
+{
+	std::vector<std::pair<std::future<void>, std::shared_ptr<stress_owner>>> draining;
+	{
+		std::lock_guard lock(slot.lock);
+		std::swap(slot.draining, draining);
+	}
+	for(auto& [drained, owner] : draining)
+	{
+		drained.wait();
+		owner->record->torn_down.store(true, std::memory_order_release);
+	}
+}
+
+// Replaces the group of the owner of `slot`, cancelling the wrappers of the previous one. From inside a call, `expected` is
+// the owner of the wrapper, and the group is only replaced if it is still the one of the wrapper, `generation`, and no other
+// call is replacing it. Returns whether it did.
+static bool regroup(owner_slot& slot, stress_owner* expected, uint64_t generation)
+{
+	std::optional<safe_callbacks_group> group;
+	{
+		std::lock_guard lock(slot.lock);
+		if(slot.owner == nullptr)
+		{
+			return false;
+		}
+		if(expected != nullptr)
+		{
+			if(slot.owner.get() != expected || expected->group_generation != generation || expected->regrouping_inside)
+			{
+				return false;
+			}
+			expected->regrouping_inside = true;
+		}
+		group = std::exchange(slot.owner->group, slot.owner->cb.group());
+		slot.owner->group_generation++;
+	}
+	// Waits for calls in flight without the slot lock, which they take to tear their owner down. The owner may be torn
+	// down on another thread meanwhile, cancelling the group as well.
+	group->cancel();
+	group.reset();
+	
+	if(expected != nullptr)
+	{
+		// The owner outlives the calls of its wrappers, even once it has left the slot.
+		std::lock_guard lock(slot.lock);
+		expected->regrouping_inside = false;
+	}
+	return true;
+}
+
+// The callable of every configuration. Touches its owner, and tears it down from inside now and then. With `regroups`,
+// it also releases its own group, `group_generation`, from inside now and then, while the owner may be torn down elsewhere.
+struct stress_body
+{
+	// Returns whether the owner is still alive, so that the caller may touch it further.
+	bool operator()() const
+	{
+		if(record->torn_down.load(std::memory_order_acquire))
+		{
+			counters->violations.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		owner->runs.fetch_add(1, std::memory_order_relaxed);
+		counters->runs.fetch_add(1, std::memory_order_relaxed);
+
+		thread_local std::minstd_rand random(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		if(random_below(random, inside_teardown_odds) == 0 && tear_down(*slot, owner, teardown, *counters))
+		{
+			// The owner is gone, its members must not be touched anymore.
+			counters->inside_teardowns.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		if(regroups && random_below(random, inside_regroup_odds) == 0)
+		{
+			regroup(*slot, owner, group_generation);
+		}
+		return true;
+	}
+
+	stress_owner* owner;
+	std::shared_ptr<stress_record> record;
+	owner_slot* slot;
+	stress_counters* counters;
+	stress_teardown teardown;
+	bool regroups;
+	uint64_t group_generation;
+};
+
+// Counters and latencies of a run, and their report.
+class stress_results
+{
+public:
+	void report(const char* name, std::chrono::milliseconds duration) const
+	{
+		auto seconds = std::chrono::duration<double>(duration).count();
+		std::printf("%-28s %10.0f %10.0f %10.0f %8.0f %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %9" PRIu64 "\n", name,
+					counters.creations / seconds, counters.calls / seconds, counters.runs / seconds, counters.teardowns / seconds, uint64_t(counters.inside_teardowns),
+					percentile(0.5), percentile(0.99), percentile(0.999), samples.empty() ? 0 : uint64_t(samples.back()),
+					uint64_t(counters.violations));
+		// A configuration which deadlocks shows up as the first one not reported.
+		std::fflush(stdout);
+	}
+
+	uint64_t violations() const
+	{
+		return counters.violations;
+	}
+
+protected:
+	// Every call which ran its callable must have been counted as an invocation, unless the configuration's calls are not
+	// counted (e.g. emissions of signals), and every wrapper must be gone once the run is over.
+	void check(const safe_callbacks::statistics& statistics, bool counts_invocations)
+	{
+		if(counts_invocations && statistics.invocations != counters.runs)
+		{
+			std::printf("%" PRIu64 " invocations counted by the statistics, %" PRIu64 " by the callables\n", uint64_t(statistics.invocations), uint64_t(counters.runs));
+			counters.violations.fetch_add(1, std::memory_order_relaxed);
+		}
+		if(statistics.live_wrappers != 0)
+		{
+			std::printf("%" PRId64 " wrappers still alive\n", int64_t(statistics.live_wrappers));
+			counters.violations.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	
+	void collect(std::vector<std::vector<uint32_t>>& latencies)
+	{
+		for(auto& thread_latencies : latencies)
+		{
+			samples.insert(samples.end(), thread_latencies.begin(), thread_latencies.end());
+		}
+		std::sort(samples.begin(), samples.end());
+	}
+
+	// Calls `call`, timing one in `latency_sampling` of them. Returns whether it called anything.
+	template <typename C>
+	static bool sample(uint32_t iteration, std::vector<uint32_t>& latencies, C&& call)
+	{
+		if(iteration % latency_sampling != 0)
+		{
+			return call();
+		}
+
+		auto start = stress_clock::now();
+		auto called = call();
+		if(called)
+		{
+			latencies.push_back(uint32_t(std::min<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stress_clock::now() - start).count(), UINT32_MAX)));
+		}
+		return called;
+	}
+
+	stress_counters counters;
+
+private:
+	uint64_t percentile(double fraction) const
+	{
+		if(samples.empty())
+		{
+			return 0;
+		}
+		return samples[std::min(samples.size() - 1, std::size_t(double(samples.size()) * fraction))];
+	}
+
+	std::vector<uint32_t> samples;
+};
+
+// Wrappers of `Policy` shared by invokers, which call copies of them. Made by the owner, or by its group if `Grouped`.
+// With `SelfReferencing`, each callable keeps a copy of its own wrapper, which only cancellation releases.
+template <typename Policy, bool Grouped = false, bool SelfReferencing = false>
+class stress_shared_wrappers
+{
+public:
+	using wrapper_type = safe_callbacks::function<int(int), void, Policy>;
+	using item_type = std::optional<wrapper_type>;
+	static constexpr bool grouped = Grouped;
+	// Whether the calls of the configuration are counted by the statistics of their owner.
+	static constexpr bool counts_invocations = true;
+
+	item_type make(stress_owner& owner, const stress_body& body)
+	{
+		if constexpr(SelfReferencing)
+		{
+			auto self = std::make_shared<item_type>();
+			*self = make_wrapper(owner, [body, self](int value) {
+				// Only kept, so that the callable refers to its own wrapper.
+				static_cast<void>(self);
+				body();
+				return value + 1;
+			});
+			return *self;
+		}
+		else
+		{
+			return make_wrapper(owner, [body](int value) { body(); return value + 1; });
+		}
+	}
+
+	void publish(item_type&& wrapper, std::minstd_rand& random)
+	{
+		auto& published = wrappers[random_below(random, wrapper_slots)];
+		std::lock_guard lock(published.lock);
+		// The replaced wrapper is released once the lock is, racing with calls of its copies and the teardown of its owner.
+		std::swap(published.wrapper, wrapper);
+	}
+
+	bool consume(int value, std::minstd_rand& random)
+	{
+		item_type wrapper;
+		{
+			auto& slot = wrappers[random_below(random, wrapper_slots)];
+			std::lock_guard lock(slot.lock);
+			wrapper = slot.wrapper;
+		}
+		if(!wrapper)
+		{
+			return false;
+		}
+		(*wrapper)(value);
+		return true;
+	}
+
+	void clear()
+	{
+		for(auto& slot : wrappers)
+		{
+			slot.wrapper.reset();
+		}
+	}
+
+private:
+	template <typename C>
+	static wrapper_type make_wrapper(stress_owner& owner, C&& callable)
+	{
+		if constexpr(Grouped)
+		{
+			return owner.group->template make_safe<Policy>(std::forward<C>(callable));
+		}
+		else
+		{
+			return owner.cb.template make_safe<Policy>(std::forward<C>(callable));
+		}
+	}
+
+	struct slot
+	{
+		std::mutex lock;
+		item_type wrapper;
+	};
+
+	slot wrappers[wrapper_slots];
+};
+
+// Wrappers made together by make_safe_all(), published to separate slots and called as shared wrappers are. The callables of
+// a batch are only released along with its last wrapper, or by its owner's teardown, while its other wrappers are called.
+class stress_batch_wrappers
+{
+public:
+	using item_type = std::array<stress_shared_wrappers<safe_callbacks::concurrent>::item_type, 3>;
+	static constexpr bool grouped = false;
+	static constexpr bool counts_invocations = true;
+
+	item_type make(stress_owner& owner, const stress_body& body)
+	{
+		auto callable = [body](int value) { body(); return value + 1; };
+		return std::apply([](auto&&... wrappers) { return item_type{std::move(wrappers)...}; }, owner.cb.make_safe_all<safe_callbacks::concurrent>(callable, callable, callable));
+	}
+
+	void publish(item_type&& batch, std::minstd_rand& random)
+	{
+		for(auto& wrapper : batch)
+		{
+			wrappers.publish(std::move(wrapper), random);
+		}
+	}
+
+	bool consume(int value, std::minstd_rand& random)
+	{
+		return wrappers.consume(value, random);
+	}
+
+	void clear()
+	{
+		wrappers.clear();
+	}
+
+private:
+	stress_shared_wrappers<safe_callbacks::concurrent> wrappers;
+};
+
+// Move-only wrappers, which invokers take out of their slot to call them, and put back unless the slot was refilled meanwhile.
+class stress_unique_wrappers
+{
+public:
+	using item_type = std::optional<safe_callbacks::unique_function<int(int)>>;
+	static constexpr bool grouped = false;
+	static constexpr bool counts_invocations = true;
+
+	item_type make(stress_owner& owner, const stress_body& body)
+	{
+		return owner.cb.make_safe_unique([body](int value) { body(); return value + 1; });
+	}
+
+	void publish(item_type&& wrapper, std::minstd_rand& random)
+	{
+		auto& published = wrappers[random_below(random, wrapper_slots)];
+		std::lock_guard lock(published.lock);
+		std::swap(published.wrapper, wrapper);
+	}
+
+	bool consume(int value, std::minstd_rand& random)
+	{
+		auto& slot = wrappers[random_below(random, wrapper_slots)];
+		item_type wrapper;
+		{
+			std::lock_guard lock(slot.lock);
+			std::swap(slot.wrapper, wrapper);
+		}
+		if(!wrapper)
+		{
+			return false;
+		}
+
+		(*wrapper)(value);
+		std::lock_guard lock(slot.lock);
+		if(!slot.wrapper)
+		{
+			std::swap(slot.wrapper, wrapper);
+		}
+		return true;
+	}
+
+	void clear()
+	{
+		for(auto& slot : wrappers)
+		{
+			slot.wrapper.reset();
+		}
+	}
+
+private:
+	struct slot
+	{
+		std::mutex lock;
+		item_type wrapper;
+	};
+
+	slot wrappers[wrapper_slots];
+};
+
+// Objects holding a wrapper of `Policy` whose callable keeps the object alive: `object → wrapper → callable → shared_ptr<object>`.
+// Invokers take an object out of its slot and call the object's own wrapper, not a copy of it. The call releases the invoker's
+// reference from inside, so that whichever cancellation releases the callable, on this thread or another, also releases the
+// wrapper being called.
+template <typename Policy>
+class stress_self_owning_wrappers
+{
+public:
+	struct object
+	{
+		std::optional<safe_callbacks::function<int(int), void, Policy>> wrapper;
+		// The invoker's reference, handed over to the call.
+		std::shared_ptr<object> caller;
+	};
+	using item_type = std::shared_ptr<object>;
+	static constexpr bool grouped = false;
+	static constexpr bool counts_invocations = true;
+
+	item_type make(stress_owner& owner, const stress_body& body)
+	{
+		auto made = std::make_shared<object>();
+		made->wrapper = owner.cb.template make_safe<Policy>([body, self = made](int value) {
+			self->caller.reset();
+			body();
+			return value + 1;
+		});
+		return made;
+	}
+
+	void publish(item_type&& made, std::minstd_rand& random)
+	{
+		auto& published = wrappers[random_below(random, wrapper_slots)];
+		std::lock_guard lock(published.lock);
+		std::swap(published.object, made);
+	}
+
+	bool consume(int value, std::minstd_rand& random)
+	{
+		item_type taken;
+		{
+			auto& slot = wrappers[random_below(random, wrapper_slots)];
+			std::lock_guard lock(slot.lock);
+			std::swap(slot.object, taken);
+		}
+		if(!taken)
+		{
+			return false;
+		}
+
+		auto called = taken.get();
+		called->caller = std::move(taken);
+		if(!called->wrapper->try_invoke(value))
+		{
+			// Dropped: the callable did not take the reference over.
+			called->caller.reset();
+		}
+		return true;
+	}
+
+	void clear()
+	{
+		for(auto& slot : wrappers)
+		{
+			slot.object.reset();
+		}
+	}
+
+private:
+	struct slot
+	{
+		std::mutex lock;
+		item_type object;
+	};
+
+	slot wrappers[wrapper_slots];
+};
+
+// Functions waiting for invokers, oldest first. The oldest are dropped when there are too many.
+template <typename F>
+class stress_queue
+{
+public:
+	void push(F&& function)
+	{
+		F dropped;
+		std::lock_guard lock(this->lock);
+		if(functions.size() == queue_capacity)
+		{
+			// Released once the lock is.
+			dropped = std::move(functions.front());
+			functions.pop_front();
+		}
+		functions.push_back(std::move(function));
+	}
+
+	F pop()
+	{
+		std::lock_guard lock(this->lock);
+		if(functions.empty())
+		{
+			return nullptr;
+		}
+		auto function = std::move(functions.front());
+		functions.pop_front();
+		return function;
+	}
+
+	void clear()
+	{
+		std::deque<F> released;
+		std::lock_guard lock(this->lock);
+		std::swap(functions, released);
+	}
+
+private:
+	std::mutex lock;
+	std::deque<F> functions;
+};
+
+// Tasks posted by creators to an executor whose queue invokers run.
+class stress_posts
+{
+public:
+	using item_type = bool;
+	static constexpr bool grouped = false;
+	static constexpr bool counts_invocations = true;
+
+	item_type make(stress_owner& owner, const stress_body& body)
+	{
+		owner.cb.post([this](std::function<void()> task) { tasks.push(std::move(task)); }, [body] { body(); });
+		return true;
+	}
+
+	void publish(item_type&&, std::minstd_rand&) {}
+
+	bool consume(int, std::minstd_rand&)
+	{
+		auto task = tasks.pop();
+		if(!task)
+		{
+			return false;
+		}
+		task();
+		return true;
+	}
+
+	void clear()
+	{
+		tasks.clear();
+	}
+
+private:
+	stress_queue<std::function<void()>> tasks;
+};
+
+// Subscribers connected by creators to a signal which invokers emit. Creators also disconnect owners now and then.
+class stress_signal
+{
+public:
+	using item_type = bool;
+	static constexpr bool grouped = false;
+	// Emissions call subscribers directly, not through wrappers.
+	static constexpr bool counts_invocations = false;
+
+	item_type make(stress_owner& owner, const stress_body& body)
+	{
+		thread_local std::minstd_rand random(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		if(random_below(random, regroup_odds) == 0)
+		{
+			signal.disconnect(owner.cb);
+		}
+		signal.connect(owner.cb, [body](int) { body(); });
+		return true;
+	}
+
+	void publish(item_type&&, std::minstd_rand&) {}
+
+	bool consume(int value, std::minstd_rand&)
+	{
+		signal.emit(value);
+		return true;
+	}
+
+	void clear() {}
+
+private:
+	safe_signal<void(int)> signal;
+};
+
+#if SAFE_CALLBACKS_COROUTINES
+// Detached coroutine, running from its start to its first suspension, and destroying itself when it completes.
+struct stress_task
+{
+	struct promise_type
+	{
+		stress_task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+// Coroutines started by creators, suspended a few times on their owner until invokers resume them.
+class stress_coroutines
+{
+public:
+	using item_type = bool;
+	static constexpr bool grouped = false;
+	// Resumptions are not wrapper calls.
+	static constexpr bool counts_invocations = false;
+
+	item_type make(stress_owner& owner, const stress_body& body)
+	{
+		await_resumptions(owner.cb, body, resumers);
+		return true;
+	}
+
+	void publish(item_type&&, std::minstd_rand&) {}
+
+	bool consume(int value, std::minstd_rand&)
+	{
+		auto resumer = resumers.pop();
+		if(!resumer)
+		{
+			return false;
+		}
+		resumer(value);
+		return true;
+	}
+
+	void clear()
+	{
+		// Releasing the resumers destroys the coroutines they would have resumed.
+		resumers.clear();
+	}
+
+private:
+	static stress_task await_resumptions(safe_callbacks& cb, stress_body body, stress_queue<std::function<void(int)>>& resumers)
+	{
+		// Calls in flight keep running while cancel_async() re-arms the owner, so they must not use it again then.
+		auto suspensions = body.teardown == stress_teardown::cancel_async ? 1 : 4;
+		for(int i = 0; i < suspensions; i++)
+		{
+			// Once resumed, the coroutine runs as a call of the owner, which is alive until the body tears it down.
+			co_await cb.async<int>([&resumers](auto resumer) { resumers.push(std::move(resumer)); });
+			if(!body())
+			{
+				co_return;
+			}
+		}
+	}
+
+	stress_queue<std::function<void(int)>> resumers;
+};
+#endif
+
+template <typename Config>
+class stress_run: public stress_results
+{
+public:
+	// With a `reclaimer`, owners hand their cancelled callables over to it, and it is flushed once the run is over.
+	stress_run(safe_callbacks::cancellation_mode mode, stress_teardown teardown, safe_callbacks::reclaimer* reclaimer = nullptr):
+		mode(mode), teardown(teardown), reclaimer(reclaimer) {}
+
+	void run(std::chrono::milliseconds duration, unsigned creator_count, unsigned invoker_count)
+	{
+		for(auto& slot : owners)
+		{
+			slot.owner = std::make_shared<stress_owner>(mode, Config::grouped, teardown, reclaimer, statistics());
+		}
+
+		auto deadline = stress_clock::now() + duration;
+		std::vector<std::thread> threads;
+		std::vector<std::vector<uint32_t>> latencies(invoker_count);
+		for(unsigned i = 0; i < creator_count; i++)
+		{
+			threads.emplace_back([this, deadline, i] { create(deadline, i); });
+		}
+		for(unsigned i = 0; i < invoker_count; i++)
+		{
+			threads.emplace_back([this, deadline, i, &latencies] { invoke(deadline, creator_count_seed + i, latencies[i]); });
+		}
+		for(auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		// Wrappers first, as owners torn down with them still around leave them cancelled, then the remaining owners.
+		published.clear();
+		for(auto& slot : owners)
+		{
+			tear_down(slot, nullptr, teardown, counters);
+			reap(slot);
+		}
+		if(reclaimer != nullptr)
+		{
+			reclaimer->flush();
+		}
+		if constexpr(safe_callbacks_config::statistics)
+		{
+			check(owner_statistics, Config::counts_invocations);
+		}
+		collect(latencies);
+	}
+
+private:
+	static constexpr unsigned creator_count_seed = 1000;
+	
+	// Shared by all owners of the run, if statistics are enabled.
+	safe_callbacks::statistics* statistics()
+	{
+		return safe_callbacks_config::statistics ? &owner_statistics : nullptr;
+	}
+
+	// Creators make wrappers on random owners and publish them, replacing older ones. Now and then, they tear an owner down
+	// and replace it with a fresh one, or replace its group.
+	void create(stress_clock::time_point deadline, unsigned seed)
+	{
+		std::minstd_rand random(seed + 1);
+		while(stress_clock::now() < deadline)
+		{
+			auto& slot = owners[random_below(random, owner_slots)];
+			if(random_below(random, teardown_odds) == 0)
+			{
+				tear_down(slot, nullptr, teardown, counters);
+				reap(slot);
+
+				auto owner = std::make_shared<stress_owner>(mode, Config::grouped, teardown, reclaimer, statistics());
+				std::lock_guard lock(slot.lock);
+				if(slot.owner == nullptr)
+				{
+					slot.owner = std::move(owner);
+				}
+				continue;
+			}
+
+			if(Config::grouped && random_below(random, regroup_odds) == 0)
+			{
+				regroup(slot, nullptr, 0);
+				continue;
+			}
+
+			std::optional<typename Config::item_type> item;
+			{
+				// The slot lock keeps the owner alive while the wrapper is made.
+				std::lock_guard lock(slot.lock);
+				if(slot.owner == nullptr)
+				{
+					continue;
+				}
+				item.emplace(published.make(*slot.owner, stress_body{slot.owner.get(), slot.owner->record, &slot, &counters, teardown, Config::grouped, slot.owner->group_generation}));
+			}
+			counters.creations.fetch_add(1, std::memory_order_relaxed);
+			published.publish(std::move(*item), random);
+		}
+	}
+
+	// Invokers call random published wrappers, timing some of the calls.
+	void invoke(stress_clock::time_point deadline, unsigned seed, std::vector<uint32_t>& latencies)
+	{
+		std::minstd_rand random(seed);
+		uint32_t iteration = 0;
+		while(stress_clock::now() < deadline)
+		{
+			++iteration;
+			if(!sample(iteration, latencies, [&] { return published.consume(int(iteration), random); }))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			counters.calls.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	const safe_callbacks::cancellation_mode mode;
+	const stress_teardown teardown;
+	safe_callbacks::reclaimer* const reclaimer;
+	// Declared before the owners, which count their activity in it.
+	safe_callbacks::statistics owner_statistics;
+	owner_slot owners[owner_slots];
+	Config published;
+};
+
+// Subscribers connected while emissions overlap without pause: one emission stays parked inside a subscriber for the whole run,
+// while invokers emit. Each creator connects an owner, waits for an emission to call it, then disconnects or releases it. Fails
+// if a subscriber is not called in time, runs after its owner's teardown, or is not removed once the creators are done.
+class stress_signal_overlap_run: public stress_results
+{
+public:
+	void run(std::chrono::milliseconds duration, unsigned creator_count, unsigned invoker_count)
+	{
+		auto deadline = stress_clock::now() + duration;
+		safe_callbacks parking;
+		signal.connect(parking, [this](int value) {
+			if(value < 0)
+			{
+				parked = true;
+				while(!stopped.load(std::memory_order_acquire))
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+		std::thread parked_emission([this] { signal.emit(-1); });
+		while(!parked.load(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+
+		std::vector<std::thread> creators;
+		std::vector<std::thread> invokers;
+		std::vector<std::vector<uint32_t>> latencies(std::max(invoker_count, 1u));
+		for(unsigned i = 0; i < latencies.size(); i++)
+		{
+			invokers.emplace_back([this, i, &latencies] { invoke(latencies[i]); });
+		}
+		for(unsigned i = 0; i < std::max(creator_count, 1u); i++)
+		{
+			creators.emplace_back([this, deadline, i] { create(deadline, i); });
+		}
+		for(auto& thread : creators)
+		{
+			thread.join();
+		}
+
+		// Released owners are found by the next emission, which frees their slots unless an invoker's emission is freeing others.
+		auto timeout = stress_clock::now() + std::chrono::seconds(1);
+		do
+		{
+			signal.emit(0);
+			if(stress_clock::now() > timeout)
+			{
+				counters.violations.fetch_add(1, std::memory_order_relaxed);
+				break;
+			}
+		}
+		while(signal.size() != 1);
+
+		stopped = true;
+		parked_emission.join();
+		for(auto& thread : invokers)
+		{
+			thread.join();
+		}
+		collect(latencies);
+	}
+
+private:
+	struct overlap_owner
+	{
+		std::atomic<uint64_t> runs = 0;
+		std::shared_ptr<stress_record> record = std::make_shared<stress_record>();
+		// Declared last, so that subscribers are cancelled before the members above are released.
+		safe_callbacks cb;
+	};
+
+	void create(stress_clock::time_point deadline, unsigned seed)
+	{
+		std::minstd_rand random(seed + 1);
+		while(stress_clock::now() < deadline)
+		{
+			auto owner = std::make_unique<overlap_owner>();
+			signal.connect(owner->cb, [raw = owner.get(), record = owner->record, counters = &counters](int) {
+				if(record->torn_down.load(std::memory_order_acquire))
+				{
+					counters->violations.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				raw->runs.fetch_add(1, std::memory_order_relaxed);
+				counters->runs.fetch_add(1, std::memory_order_relaxed);
+			});
+			counters.creations.fetch_add(1, std::memory_order_relaxed);
+
+			auto timeout = stress_clock::now() + std::chrono::seconds(1);
+			while(owner->runs.load(std::memory_order_relaxed) == 0)
+			{
+				if(stress_clock::now() > timeout)
+				{
+					counters.violations.fetch_add(1, std::memory_order_relaxed);
+					break;
+				}
+				std::this_thread::yield();
+			}
+
+			if(random_below(random, 2) == 0)
+			{
+				signal.disconnect(owner->cb);
+			}
+			auto record = owner->record;
+			owner.reset();
+			record->torn_down = true;
+			counters.teardowns.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void invoke(std::vector<uint32_t>& latencies)
+	{
+		uint32_t iteration = 0;
+		while(!stopped.load(std::memory_order_acquire))
+		{
+			sample(++iteration, latencies, [&] { signal.emit(int(iteration)); return true; });
+			counters.calls.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	safe_signal<void(int)> signal;
+	std::atomic<bool> parked = false;
+	std::atomic<bool> stopped = false;
+};
+
+// Single-threaded owners: each invoker thread makes, calls and tears down its own, teardown from inside callbacks included.
+class local_stress_run: public stress_results
+{
+public:
+	// With `self_referencing`, each callable keeps a copy of its own wrapper, as stress_shared_wrappers does.
+	local_stress_run(bool self_referencing): self_referencing(self_referencing) {}
+
+	void run(std::chrono::milliseconds duration, unsigned, unsigned invoker_count)
+	{
+		auto deadline = stress_clock::now() + duration;
+		std::vector<std::thread> threads;
+		std::vector<std::vector<uint32_t>> latencies(invoker_count);
+		for(unsigned i = 0; i < invoker_count; i++)
+		{
+			threads.emplace_back([this, deadline, i, &latencies] { invoke(deadline, i, latencies[i]); });
+		}
+		for(auto& thread : threads)
+		{
+			thread.join();
+		}
+		collect(latencies);
+	}
+
+private:
+	struct local_owner
+	{
+		uint64_t runs = 0;
+		std::shared_ptr<stress_record> record = std::make_shared<stress_record>();
+		// Declared last, so that wrappers are cancelled before the members above are released.
+		local_safe_callbacks cb;
+	};
+
+	static void tear_down(std::unique_ptr<local_owner>& owner, stress_counters& counters)
+	{
+		auto record = owner->record;
+		owner.reset();
+		record->torn_down = true;
+		counters.teardowns.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void invoke(stress_clock::time_point deadline, unsigned seed, std::vector<uint32_t>& latencies)
+	{
+		std::minstd_rand random(seed + 1);
+		std::unique_ptr<local_owner> owners[owner_slots];
+		// Declared last, so that wrappers are released before their owners, as in the other configurations.
+		std::optional<local_safe_callbacks::function<int(int)>> wrappers[wrapper_slots];
+		uint32_t iteration = 0;
+		while(stress_clock::now() < deadline)
+		{
+			auto& owner = owners[random_below(random, owner_slots)];
+			if(owner == nullptr)
+			{
+				owner = std::make_unique<local_owner>();
+			}
+			else if(random_below(random, teardown_odds) == 0)
+			{
+				tear_down(owner, counters);
+				continue;
+			}
+
+			auto counters = &this->counters;
+			auto body = [&owner, raw = owner.get(), record = owner->record, counters, &random](int value) {
+				if(record->torn_down)
+				{
+					counters->violations.fetch_add(1, std::memory_order_relaxed);
+					return value;
+				}
+
+				raw->runs++;
+				counters->runs.fetch_add(1, std::memory_order_relaxed);
+				if(random_below(random, inside_teardown_odds) == 0 && owner.get() == raw)
+				{
+					tear_down(owner, *counters);
+					counters->inside_teardowns.fetch_add(1, std::memory_order_relaxed);
+				}
+				return value + 1;
+			};
+			auto& published = wrappers[random_below(random, wrapper_slots)];
+			if(self_referencing)
+			{
+				// Captured last, so that it is destroyed first: the rest of the callable is destroyed after the last copy of its
+				// own wrapper, which only the owner's teardown releases.
+				auto self = std::make_shared<std::optional<local_safe_callbacks::function<int(int)>>>();
+				*self = owner->cb.make_safe([body, self](int value) { return body(value); });
+				published = *self;
+			}
+			else
+			{
+				published = owner->cb.make_safe(body);
+			}
+			counters->creations.fetch_add(1, std::memory_order_relaxed);
+
+			auto& wrapper = wrappers[random_below(random, wrapper_slots)];
+			if(!wrapper)
+			{
+				continue;
+			}
+			// Copied, as the call may replace the slot's wrapper.
+			auto called = *wrapper;
+			sample(++iteration, latencies, [&] { called(int(iteration)); return true; });
+			counters->calls.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	const bool self_referencing;
+};
+
+// Memory resource counting the allocations made from it, and recording the alignment of the last one.
+class stress_counting_resource: public std::pmr::memory_resource
+{
+public:
+	std::size_t allocations = 0;
+	std::size_t outstanding = 0;
+	std::size_t last_alignment = 0;
+
+private:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		allocations++;
+		outstanding++;
+		last_alignment = alignment;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override
+	{
+		outstanding--;
+		std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+// Stateless factory of a default return value.
+struct stress_cancelled_text
+{
+	std::string operator()() const
+	{
+		return "cancelled";
+	}
+};
+
+static std::atomic<uint64_t> traced_events = 0;
+
+// Single-threaded checks of what the configurations do not exercise. Returns how many failed.
+static uint64_t check_features()
+{
+	uint64_t failures = 0;
+	auto expect = [&failures](bool condition, const char* what) {
+		if(!condition)
+		{
+			std::printf("check failed: %s\n", what);
+			failures++;
+		}
+	};
+	auto fresh_value = [] { return std::make_unique<int>(-1); };
+	auto boxed = [](int value) { return std::make_unique<int>(value); };
+
+	// Default return values known at compile time, or made for each cancelled call.
+	{
+		std::optional<safe_callbacks> cb(std::in_place);
+		auto constant = cb->make_safe(safe_callbacks::default_constant<-1>(), [](int value) { return value; });
+		auto made = cb->make_safe(safe_callbacks::default_from(fresh_value), boxed);
+		auto text = cb->make_safe(safe_callbacks::default_factory<stress_cancelled_text>(), [] { return std::string("called"); });
+		expect(constant.is_alive() && constant(1) == 1, "a wrapper runs its callable until its owner is released");
+		expect(*made(1) == 1 && text() == "called", "a wrapper with a default factory runs its callable");
+
+		cb.reset();
+		expect(!constant.is_alive() && !made.is_alive(), "a wrapper is not alive once its owner is released");
+		expect(constant(1) == -1 && constant(2) == -1, "cancelled calls return the constant default value");
+		auto first = made(1);
+		auto second = made(2);
+		expect(first != nullptr && second != nullptr && first != second && *first == -1 && *second == -1, "cancelled calls return a fresh move-only default value each");
+		expect(text() == "cancelled", "cancelled calls return the value of a stateless default factory");
+	}
+
+	// Move-only default return values of once wrappers.
+	{
+		std::optional<safe_callbacks> cb(std::in_place);
+		auto called = cb->make_safe_once(std::make_unique<int>(-1), boxed);
+		auto cancelled = cb->make_safe_once(std::make_unique<int>(-1), boxed);
+		auto made = cb->make_safe_once(safe_callbacks::default_from(fresh_value), boxed);
+		expect(called.is_alive() && *called(1) == 1, "the first call of a once wrapper runs its callable");
+		expect(!called.is_alive() && called(2) == nullptr, "later calls of a once wrapper with a move-only default value return a default constructed value");
+		expect(*made(1) == 1 && *made(2) == -1, "later calls of a once wrapper return the value of its default factory");
+
+		cb.reset();
+		auto first = cancelled(1);
+		expect(first != nullptr && *first == -1 && cancelled(2) == nullptr, "only the first cancelled call of a once wrapper returns its move-only default value");
+		expect(*made(3) == -1 && *made(4) == -1, "cancelled calls of a once wrapper return the value of its default factory");
+	}
+
+	// Move-only default return values of single-threaded wrappers.
+	{
+		std::optional<local_safe_callbacks> cb(std::in_place);
+		auto moved = cb->make_safe(std::make_unique<int>(-1), boxed);
+		auto made = cb->make_safe(safe_callbacks::default_from(fresh_value), boxed);
+		auto constant = cb->make_safe(local_safe_callbacks::default_constant<-1>(), [](int value) { return value; });
+		expect(moved.is_alive() && *moved(1) == 1 && *made(1) == 1 && constant(1) == 1, "a local wrapper runs its callable until its owner is released");
+
+		cb.reset();
+		expect(!made.is_alive(), "a local wrapper is not alive once its owner is released");
+		auto first = moved(1);
+		expect(first != nullptr && *first == -1, "the first cancelled call of a local wrapper returns its move-only default value");
+		auto made_first = made(1);
+		auto made_second = made(2);
+		expect(made_first != nullptr && made_second != nullptr && made_first != made_second && *made_first == -1 && *made_second == -1, "cancelled calls of a local wrapper return a fresh move-only default value each");
+		expect(constant(1) == -1, "cancelled calls of a local wrapper return the constant default value");
+	}
+
+	// Memory resources, and padded wrappers.
+	{
+		stress_counting_resource resource;
+		{
+			safe_callbacks::options options;
+			options.resource = &resource;
+			safe_callbacks cb(options);
+			auto allocations = resource.allocations;
+			auto wrapper = cb.make_safe([](int value) { return value + 1; });
+			expect(resource.allocations == allocations + 1 && wrapper(1) == 2, "a wrapper allocates its state from its owner's memory resource, once");
+			expect(!safe_callbacks_config::padded_wrappers || resource.last_alignment >= 64, "the state of padded wrappers is aligned to cache lines");
+		}
+		expect(resource.allocations != 0 && resource.outstanding == 0, "everything allocated from an owner's memory resource is freed");
+	}
+
+	// Tracing hooks.
+	{
+		safe_callbacks::set_trace_hook([](safe_callbacks::trace_event, const char*) { traced_events.fetch_add(1, std::memory_order_relaxed); });
+		{
+			safe_callbacks cb;
+			auto wrapper = cb.make_safe([] {});
+			wrapper();
+		}
+		safe_callbacks::set_trace_hook(nullptr);
+		expect((traced_events != 0) == safe_callbacks_config::tracing, "tracing events are reported to the installed hook if tracing is enabled");
+	}
+
+	return failures;
+}
+
+template <typename Run, typename ...A>
+static uint64_t stress(const char* name, std::chrono::milliseconds duration, unsigned creators, unsigned invokers, A... arguments)
+{
+	auto run = std::make_unique<Run>(arguments...);
+	run->run(duration, creators, invokers);
+	run->report(name, duration);
+	return run->violations();
+}
+
+int main(int argc, const char* argv[])
+{
+	auto seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+	auto creators = argc > 2 ? unsigned(std::atoi(argv[2])) : 2u;
+	auto invokers = argc > 3 ? unsigned(std::atoi(argv[3])) : 4u;
+	auto duration = std::chrono::milliseconds(int64_t(seconds * 1000));
+
+	std::printf("%u creator threads, %u invoker threads, %.1fs per configuration\n", creators, invokers, seconds);
+	std::printf("%-28s %10s %10s %10s %8s %8s %8s %8s %8s %8s %9s\n", "configuration", "creates/s", "calls/s", "runs/s", "owners/s", "inside", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "violations");
+
+	using mode = safe_callbacks::cancellation_mode;
+	using concurrent = stress_shared_wrappers<safe_callbacks::concurrent>;
+	using serialized = stress_shared_wrappers<safe_callbacks::serialized>;
+	using once = stress_shared_wrappers<safe_callbacks::once>;
+	using grouped = stress_shared_wrappers<safe_callbacks::concurrent, true>;
+	// Callables keeping their own wrapper: cancelling them releases the last copy of their wrapper. Generation mode releases
+	// cancelled callables along with their last wrapper copy only, so they would never be released there.
+	using self_referencing = stress_shared_wrappers<safe_callbacks::concurrent, false, true>;
+	// Objects owning their wrapper through its callable: the cancellation ending a call may release the wrapper being called.
+	using self_owning = stress_self_owning_wrappers<safe_callbacks::serialized>;
+	// Outlive every owner and wrapper of the runs using them.
+	safe_callbacks::background_reclaimer reclaimer;
+	auto& shared_reclaimer = safe_callbacks::background_reclaimer::shared();
+	uint64_t violations = check_features();
+	violations += stress<stress_run<concurrent>>("per_wrapper/concurrent", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<serialized>>("per_wrapper/serialized", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<concurrent>>("generation/concurrent", duration, creators, invokers, mode::generation, stress_teardown::release);
+	violations += stress<stress_run<serialized>>("generation/serialized", duration, creators, invokers, mode::generation, stress_teardown::release);
+	violations += stress<stress_run<once>>("per_wrapper/once", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<once>>("generation/once", duration, creators, invokers, mode::generation, stress_teardown::release);
+	violations += stress<stress_run<stress_unique_wrappers>>("per_wrapper/unique", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<grouped>>("per_wrapper/group", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<grouped>>("generation/group", duration, creators, invokers, mode::generation, stress_teardown::release);
+	violations += stress<stress_run<self_referencing>>("per_wrapper/self_referencing", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<self_owning>>("per_wrapper/self_owning", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<stress_batch_wrappers>>("per_wrapper/batch", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<stress_batch_wrappers>>("generation/batch", duration, creators, invokers, mode::generation, stress_teardown::release);
+	violations += stress<stress_run<stress_batch_wrappers>>("batch/cancel_async", duration, creators, invokers, mode::per_wrapper, stress_teardown::cancel_async);
+	// Cancelled callables are destroyed on the reclaimer's thread, releasing the wrappers or objects they hold there, while
+	// other threads call, copy and release them. Reclaiming is per wrapper: generation mode never hands callables over.
+	violations += stress<stress_run<concurrent>>("per_wrapper/reclaimer", duration, creators, invokers, mode::per_wrapper, stress_teardown::release, &reclaimer);
+	violations += stress<stress_run<self_referencing>>("self_referencing/reclaimer", duration, creators, invokers, mode::per_wrapper, stress_teardown::release, &reclaimer);
+	violations += stress<stress_run<self_owning>>("self_owning/reclaimer", duration, creators, invokers, mode::per_wrapper, stress_teardown::cancel_async, &reclaimer);
+	violations += stress<stress_run<stress_batch_wrappers>>("batch/reclaimer", duration, creators, invokers, mode::per_wrapper, stress_teardown::release, &shared_reclaimer);
+	violations += stress<stress_run<concurrent>>("per_wrapper/cancel_async", duration, creators, invokers, mode::per_wrapper, stress_teardown::cancel_async);
+	violations += stress<stress_run<concurrent>>("generation/cancel_async", duration, creators, invokers, mode::generation, stress_teardown::cancel_async);
+	violations += stress<stress_run<concurrent>>("per_wrapper/cancel_future", duration, creators, invokers, mode::per_wrapper, stress_teardown::cancel_future);
+	violations += stress<stress_run<serialized>>("generation/cancel_future", duration, creators, invokers, mode::generation, stress_teardown::cancel_future);
+	violations += stress<stress_run<concurrent>>("per_wrapper/detached", duration, creators, invokers, mode::per_wrapper, stress_teardown::detached);
+	violations += stress<stress_run<serialized>>("generation/detached", duration, creators, invokers, mode::generation, stress_teardown::detached);
+	violations += stress<stress_run<self_owning>>("self_owning/detached", duration, creators, invokers, mode::per_wrapper, stress_teardown::detached);
+	// Wrappers in per_wrapper mode are cancelled through their own translation unit's code, the owner's gate by the other one's.
+	violations += stress<stress_run<serialized>>("generation/other_tu", duration, creators, invokers, mode::generation, stress_teardown::elsewhere);
+	violations += stress<stress_run<stress_posts>>("post", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<stress_posts>>("post/cancel_async", duration, creators, invokers, mode::per_wrapper, stress_teardown::cancel_async);
+	violations += stress<stress_run<stress_posts>>("post/other_tu", duration, creators, invokers, mode::per_wrapper, stress_teardown::elsewhere);
+	violations += stress<stress_run<stress_signal>>("signal", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_signal_overlap_run>("signal/overlapping", duration, creators, invokers);
+#if SAFE_CALLBACKS_COROUTINES
+	violations += stress<stress_run<stress_coroutines>>("async", duration, creators, invokers, mode::per_wrapper, stress_teardown::release);
+	violations += stress<stress_run<stress_coroutines>>("async/cancel_async", duration, creators, invokers, mode::per_wrapper, stress_teardown::cancel_async);
+#endif
+	violations += stress<local_stress_run>("local", duration, creators, invokers, false);
+	violations += stress<local_stress_run>("local/self_referencing", duration, creators, invokers, true);
+
+	if(violations != 0)
+	{
+		std::printf("FAILED: %" PRIu64 " violations, e.g. callbacks run after their owner was torn down\n", violations);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,14 @@
+//
+//  SafeCallbacksStressElsewhere.cpp
+//  SafeCallbacks
+//
+//  Owner teardown built in another translation unit than the wrappers and calls of the stress test, so that it checks
+//  calls in flight, and teardown from inside them, across translation units.
+//
+
+#include "SafeCallbacks.hpp"
+
+void stress_cancel_elsewhere(safe_callbacks& cb)
+{
+	cb.cancel_all();
+}
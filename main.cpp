@@ -5,13 +5,17 @@
 //  Created by Léo Natan on 8/9/24.
 //
 
+#if !defined(SAFE_CALLBACKS_DEBUG_PRINTS)
 #define SAFE_CALLBACKS_DEBUG_PRINTS 1
+#endif
 
 #include "SafeCallbacks.hpp"
 
 #include <functional>
 #include <memory>
+#if __cplusplus > 202002L
 #include <print>
+#endif
 #include <thread>
 #include <chrono>
 
@@ -32,7 +36,7 @@
 #endif
 
 #if __cplusplus <= 202002L
-#if __cplusplus == 202002L
+#if __cplusplus == 202002L && __has_include(<format>)
 #include <format>
 #include <iostream>
 